@@ -0,0 +1,46 @@
+#pragma once
+
+#include "rt.h"
+
+// Axis-aligned bounding box, stored as its two extreme corners
+class aabb {
+    public:
+        point3 minimum;
+        point3 maximum;
+
+    public:
+        aabb() {}
+        aabb(const point3& a, const point3& b) : minimum(a), maximum(b) {}
+
+        point3 min() const {return minimum;}
+        point3 max() const {return maximum;}
+
+        // Slab test, the ray overlaps the box if the [t_min, t_max] intervals
+        // of all three slabs overlap each other
+        bool hit(const ray& r, double t_min, double t_max) const {
+            for (int a = 0; a < 3; a++) {
+                auto inv_d = 1.0 / r.direction()[a];
+                auto t0 = (minimum[a] - r.origin()[a]) * inv_d;
+                auto t1 = (maximum[a] - r.origin()[a]) * inv_d;
+                if (inv_d < 0.0)
+                    std::swap(t0, t1);
+                t_min = t0 > t_min ? t0 : t_min;
+                t_max = t1 < t_max ? t1 : t_max;
+                if (t_max <= t_min)
+                    return false;
+            }
+            return true;
+        }
+};
+
+inline aabb surrounding_box(const aabb& box0, const aabb& box1) {
+    point3 small(fmin(box0.min().x(), box1.min().x()),
+                 fmin(box0.min().y(), box1.min().y()),
+                 fmin(box0.min().z(), box1.min().z()));
+
+    point3 big(fmax(box0.max().x(), box1.max().x()),
+               fmax(box0.max().y(), box1.max().y()),
+               fmax(box0.max().z(), box1.max().z()));
+
+    return aabb(small, big);
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "hittable.h"
+#include "vec3.h"
+
+// Axis-aligned rectangles, one class per plane so that the intersection
+// only ever touches the two axes that matter.
+// Each has a thin box around it, a box with no thickness breaks the slab test.
+
+// Rectangle [x0, x1] x [y0, y1] at z = k, facing +z
+class xy_rect : public hittable {
+    public:
+        double x0, x1, y0, y1, k;
+        shared_ptr<material> mat_ptr;
+
+    public:
+        xy_rect() {}
+        xy_rect(double _x0, double _x1, double _y0, double _y1, double _k, shared_ptr<material> m)
+            : x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), mat_ptr(m) {};
+
+        virtual bool hit(
+                const ray& r, double t_min, double t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb& output_box) const override {
+            output_box = aabb(point3(x0, y0, k - 0.0001), point3(x1, y1, k + 0.0001));
+            return true;
+        }
+
+        virtual void collect_materials(std::vector<shared_ptr<material>>& out) const override {
+            out.push_back(mat_ptr);
+        }
+};
+
+// Rectangle [x0, x1] x [z0, z1] at y = k, facing +y
+class xz_rect : public hittable {
+    public:
+        double x0, x1, z0, z1, k;
+        shared_ptr<material> mat_ptr;
+
+    public:
+        xz_rect() {}
+        xz_rect(double _x0, double _x1, double _z0, double _z1, double _k, shared_ptr<material> m)
+            : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), mat_ptr(m) {};
+
+        virtual bool hit(
+                const ray& r, double t_min, double t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb& output_box) const override {
+            output_box = aabb(point3(x0, k - 0.0001, z0), point3(x1, k + 0.0001, z1));
+            return true;
+        }
+
+        virtual void collect_materials(std::vector<shared_ptr<material>>& out) const override {
+            out.push_back(mat_ptr);
+        }
+};
+
+// Rectangle [y0, y1] x [z0, z1] at x = k, facing +x
+class yz_rect : public hittable {
+    public:
+        double y0, y1, z0, z1, k;
+        shared_ptr<material> mat_ptr;
+
+    public:
+        yz_rect() {}
+        yz_rect(double _y0, double _y1, double _z0, double _z1, double _k, shared_ptr<material> m)
+            : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), mat_ptr(m) {};
+
+        virtual bool hit(
+                const ray& r, double t_min, double t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb& output_box) const override {
+            output_box = aabb(point3(k - 0.0001, y0, z0), point3(k + 0.0001, y1, z1));
+            return true;
+        }
+
+        virtual void collect_materials(std::vector<shared_ptr<material>>& out) const override {
+            out.push_back(mat_ptr);
+        }
+};
+
+bool xy_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    // Parallel to the rectangle
+    if (r.direction().z() == 0)
+        return false;
+
+    auto t = (k - r.origin().z()) / r.direction().z();
+    if (t < t_min || t > t_max)
+        return false;
+
+    auto x = r.origin().x() + t * r.direction().x();
+    auto y = r.origin().y() + t * r.direction().y();
+    if (x < x0 || x > x1 || y < y0 || y > y1)
+        return false;
+
+    rec.t = t;
+    rec.p = r.at(t);
+    rec.set_face_normal(r, vec3(0, 0, 1));
+    rec.mat_ptr = mat_ptr;
+    return true;
+}
+
+bool xz_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    // Parallel to the rectangle
+    if (r.direction().y() == 0)
+        return false;
+
+    auto t = (k - r.origin().y()) / r.direction().y();
+    if (t < t_min || t > t_max)
+        return false;
+
+    auto x = r.origin().x() + t * r.direction().x();
+    auto z = r.origin().z() + t * r.direction().z();
+    if (x < x0 || x > x1 || z < z0 || z > z1)
+        return false;
+
+    rec.t = t;
+    rec.p = r.at(t);
+    rec.set_face_normal(r, vec3(0, 1, 0));
+    rec.mat_ptr = mat_ptr;
+    return true;
+}
+
+bool yz_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    // Parallel to the rectangle
+    if (r.direction().x() == 0)
+        return false;
+
+    auto t = (k - r.origin().x()) / r.direction().x();
+    if (t < t_min || t > t_max)
+        return false;
+
+    auto y = r.origin().y() + t * r.direction().y();
+    auto z = r.origin().z() + t * r.direction().z();
+    if (y < y0 || y > y1 || z < z0 || z > z1)
+        return false;
+
+    rec.t = t;
+    rec.p = r.at(t);
+    rec.set_face_normal(r, vec3(1, 0, 0));
+    rec.mat_ptr = mat_ptr;
+    return true;
+}
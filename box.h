@@ -0,0 +1,78 @@
+#pragma once
+
+#include "hittable.h"
+#include "vec3.h"
+
+// Axis-aligned box between two corners.
+// Intersected directly with the slab test instead of as six rectangles, the
+// axis of the slab that was entered (or left, from the inside) is the normal.
+class box : public hittable {
+    public:
+        point3 box_min;
+        point3 box_max;
+        shared_ptr<material> mat_ptr;
+
+    public:
+        box() {}
+        box(const point3& p0, const point3& p1, shared_ptr<material> m)
+            : box_min(fmin(p0.x(), p1.x()), fmin(p0.y(), p1.y()), fmin(p0.z(), p1.z())),
+              box_max(fmax(p0.x(), p1.x()), fmax(p0.y(), p1.y()), fmax(p0.z(), p1.z())),
+              mat_ptr(m) {};
+
+        virtual bool hit(
+                const ray& r, double t_min, double t_max, hit_record& rec) const override;
+
+        virtual bool bounding_box(aabb& output_box) const override {
+            output_box = aabb(box_min, box_max);
+            return true;
+        }
+
+        virtual void collect_materials(std::vector<shared_ptr<material>>& out) const override {
+            out.push_back(mat_ptr);
+        }
+};
+
+bool box::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    double t_near = -infinity;
+    double t_far = infinity;
+    int near_axis = 0;
+    int far_axis = 0;
+
+    for (int a = 0; a < 3; a++) {
+        auto inv_d = 1.0 / r.direction()[a];
+        auto t0 = (box_min[a] - r.origin()[a]) * inv_d;
+        auto t1 = (box_max[a] - r.origin()[a]) * inv_d;
+        if (inv_d < 0.0)
+            std::swap(t0, t1);
+        if (t0 > t_near) {
+            t_near = t0;
+            near_axis = a;
+        }
+        if (t1 < t_far) {
+            t_far = t1;
+            far_axis = a;
+        }
+        if (t_far < t_near)
+            return false;
+    }
+
+    // Entering the box, or leaving it when the ray starts inside
+    double t = t_near;
+    int axis = near_axis;
+    if (t < t_min || t_max < t) {
+        t = t_far;
+        axis = far_axis;
+        if (t < t_min || t_max < t)
+            return false;
+    }
+
+    rec.t = t;
+    rec.p = r.at(t);
+    vec3 outward_normal;
+    // Which of the two faces on the axis depends on the side the ray is on
+    outward_normal[axis] = rec.p[axis] < 0.5 * (box_min[axis] + box_max[axis]) ? -1 : 1;
+    rec.set_face_normal(r, outward_normal);
+    rec.mat_ptr = mat_ptr;
+
+    return true;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+
+#include "rt.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+// Bounding volume hierarchy over bounded objects only, unbounded objects
+// (planes) have no box to put into the tree, see build_bvh_world
+class bvh_node : public hittable {
+    public:
+        shared_ptr<hittable> left;
+        shared_ptr<hittable> right;
+        aabb box;
+
+    public:
+        bvh_node() {}
+        // The list is taken by value, building the tree reorders the objects
+        bvh_node(hittable_list list) : bvh_node(list.objects, 0, list.objects.size()) {}
+        bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end);
+
+        virtual bool hit(
+                const ray& r, double t_min, double t_max, hit_record& rec) const override;
+        virtual bool bounding_box(aabb& output_box) const override;
+
+        virtual void collect_materials(std::vector<shared_ptr<material>>& out) const override {
+            left->collect_materials(out);
+            right->collect_materials(out);
+        }
+};
+
+bool bvh_node::bounding_box(aabb& output_box) const {
+    output_box = box;
+    return true;
+}
+
+bool bvh_node::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    if (!box.hit(r, t_min, t_max))
+        return false;
+
+    bool hit_left = left->hit(r, t_min, t_max, rec);
+    // Only look for something in the right child closer than the left hit
+    bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
+
+    return hit_left || hit_right;
+}
+
+bvh_node::bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) {
+    // Split along the longest axis of the box around the centers, which keeps
+    // the tree deterministic, unlike picking a random axis
+    aabb centroid_box;
+    for (size_t i = start; i < end; i++) {
+        aabb b;
+        objects[i]->bounding_box(b);
+        auto c = 0.5 * (b.min() + b.max());
+        centroid_box = i == start ? aabb(c, c) : surrounding_box(centroid_box, aabb(c, c));
+    }
+
+    auto extent = centroid_box.max() - centroid_box.min();
+    int axis = 0;
+    if (extent.y() > extent[axis])
+        axis = 1;
+    if (extent.z() > extent[axis])
+        axis = 2;
+
+    auto comparator = [axis](const shared_ptr<hittable>& a, const shared_ptr<hittable>& b) {
+        aabb box_a;
+        aabb box_b;
+        a->bounding_box(box_a);
+        b->bounding_box(box_b);
+        return box_a.min()[axis] + box_a.max()[axis] < box_b.min()[axis] + box_b.max()[axis];
+    };
+
+    size_t object_span = end - start;
+
+    if (object_span == 1) {
+        left = right = objects[start];
+    } else if (object_span == 2) {
+        if (comparator(objects[start], objects[start + 1])) {
+            left = objects[start];
+            right = objects[start + 1];
+        } else {
+            left = objects[start + 1];
+            right = objects[start];
+        }
+    } else {
+        auto mid = start + object_span / 2;
+        std::nth_element(objects.begin() + start, objects.begin() + mid,
+                         objects.begin() + end, comparator);
+
+        left = make_shared<bvh_node>(objects, start, mid);
+        right = make_shared<bvh_node>(objects, mid, end);
+    }
+
+    aabb box_left;
+    aabb box_right;
+    left->bounding_box(box_left);
+    right->bounding_box(box_right);
+
+    box = surrounding_box(box_left, box_right);
+}
+
+// Put every bounded object of the list into a bvh, unbounded objects are
+// tested on their own next to it, they would make every box in the tree infinite
+hittable_list build_bvh_world(const hittable_list& list) {
+    hittable_list bounded;
+    hittable_list world;
+    aabb box;
+
+    for (const auto& object : list.objects) {
+        if (object->bounding_box(box))
+            bounded.add(object);
+        else
+            world.add(object);
+    }
+
+    if (!bounded.objects.empty())
+        world.add(make_shared<bvh_node>(bounded));
+
+    return world;
+}
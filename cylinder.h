@@ -0,0 +1,93 @@
+#pragma once
+
+#include "hittable.h"
+#include "vec3.h"
+
+// Closed cylinder of `radius`, from `base` up `height` along `axis`
+class cylinder : public hittable {
+    public:
+        point3 base;
+        vec3 axis;
+        double radius;
+        double height;
+        shared_ptr<material> mat_ptr;
+
+    public:
+        cylinder() {}
+        cylinder(point3 b, vec3 a, double r, double h, shared_ptr<material> m)
+            : base(b), axis(unit_vector(a)), radius(r), height(h), mat_ptr(m) {};
+
+        virtual bool hit(
+                const ray& r, double t_min, double t_max, hit_record& rec) const override;
+        virtual bool bounding_box(aabb& output_box) const override;
+        virtual void collect_materials(std::vector<shared_ptr<material>>& out) const override {
+            out.push_back(mat_ptr);
+        }
+};
+
+bool cylinder::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    vec3 origin_base = r.origin() - base;
+    auto d_axis = dot(r.direction(), axis);
+    auto o_axis = dot(origin_base, axis);
+
+    bool hit_anything = false;
+    vec3 outward_normal;
+
+    // Side, the sphere equation with the components along the axis removed
+    vec3 d_perp = r.direction() - d_axis * axis;
+    vec3 o_perp = origin_base - o_axis * axis;
+    auto a = d_perp.length_squared();
+    if (a > 0) {
+        auto half_b = dot(o_perp, d_perp);
+        auto c = o_perp.length_squared() - radius * radius;
+        auto discriminant = half_b * half_b - a * c;
+
+        if (discriminant >= 0) {
+            auto sqrtd = sqrt(discriminant);
+            for (auto root : {(-half_b - sqrtd) / a, (-half_b + sqrtd) / a}) {
+                auto h = o_axis + root * d_axis;
+                if (root < t_min || t_max < root || h < 0 || h > height)
+                    continue;
+                t_max = root;
+                outward_normal = (o_perp + root * d_perp) / radius;
+                hit_anything = true;
+                break;
+            }
+        }
+    }
+
+    // Caps, only closer than whatever was hit on the side
+    if (d_axis != 0) {
+        for (auto cap : {0.0, height}) {
+            auto t = (cap - o_axis) / d_axis;
+            if (t < t_min || t_max < t)
+                continue;
+            if ((o_perp + t * d_perp).length_squared() > radius * radius)
+                continue;
+            t_max = t;
+            outward_normal = cap == 0 ? -axis : axis;
+            hit_anything = true;
+        }
+    }
+
+    if (!hit_anything)
+        return false;
+
+    rec.t = t_max;
+    rec.p = r.at(rec.t);
+    rec.set_face_normal(r, outward_normal);
+    rec.mat_ptr = mat_ptr;
+
+    return true;
+}
+
+bool cylinder::bounding_box(aabb& output_box) const {
+    // Both caps are disks, so this is the box around the two cap disks
+    vec3 extent(radius * sqrt(fmax(0.0, 1 - axis.x() * axis.x())),
+                radius * sqrt(fmax(0.0, 1 - axis.y() * axis.y())),
+                radius * sqrt(fmax(0.0, 1 - axis.z() * axis.z())));
+    point3 top = base + height * axis;
+    output_box = surrounding_box(aabb(base - extent, base + extent),
+                                 aabb(top - extent, top + extent));
+    return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "hittable.h"
+#include "vec3.h"
+
+// Flat disk of `radius` around `center`, facing `normal`
+class disk : public hittable {
+    public:
+        point3 center;
+        vec3 normal;
+        double radius;
+        shared_ptr<material> mat_ptr;
+
+    public:
+        disk() {}
+        disk(point3 c, vec3 n, double r, shared_ptr<material> m)
+            : center(c), normal(unit_vector(n)), radius(r), mat_ptr(m) {};
+
+        virtual bool hit(
+                const ray& r, double t_min, double t_max, hit_record& rec) const override;
+        virtual bool bounding_box(aabb& output_box) const override;
+        virtual void collect_materials(std::vector<shared_ptr<material>>& out) const override {
+            out.push_back(mat_ptr);
+        }
+};
+
+bool disk::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    // Same as the plane, then reject anything outside of the radius
+    auto denom = dot(normal, r.direction());
+    if (denom == 0)
+        return false;
+
+    auto t = dot(center - r.origin(), normal) / denom;
+    if (t < t_min || t_max < t)
+        return false;
+
+    auto p = r.at(t);
+    if ((p - center).length_squared() > radius * radius)
+        return false;
+
+    rec.t = t;
+    rec.p = p;
+    rec.set_face_normal(r, normal);
+    rec.mat_ptr = mat_ptr;
+
+    return true;
+}
+
+bool disk::bounding_box(aabb& output_box) const {
+    // How far the rim reaches along each axis, radius * sin(angle to the axis).
+    // Padded so that a disk facing an axis still has some thickness.
+    vec3 extent(radius * sqrt(fmax(0.0, 1 - normal.x() * normal.x())) + 0.0001,
+                radius * sqrt(fmax(0.0, 1 - normal.y() * normal.y())) + 0.0001,
+                radius * sqrt(fmax(0.0, 1 - normal.z() * normal.z())) + 0.0001);
+    output_box = aabb(center - extent, center + extent);
+    return true;
+}
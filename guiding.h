@@ -0,0 +1,357 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "rt.h"
+#include "aabb.h"
+
+// Path guiding, learns where the light at a point comes from while rendering
+// and sends diffuse bounces that way.
+// Follows "Practical Path Guiding for Efficient Light-Transport Simulation"
+// (Muller et al. 2017): a binary tree splits the scene in space, and every
+// leaf of it has a quadtree over the sphere of directions.
+//
+// Directions map onto the unit square with (cos theta, phi), which preserves
+// area, so a density on the square is the density on the sphere times 4 pi.
+
+inline void atomic_add(std::atomic<double>& a, double value) {
+    auto current = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+        ;
+}
+
+// `d` has to be a unit vector
+inline void direction_to_square(const vec3& d, double& u, double& v) {
+    auto cos_theta = clamp(d.z(), -1.0, 1.0);
+    auto phi = atan2(d.y(), d.x());
+    if (phi < 0)
+        phi += 2 * pi;
+    // Stay inside [0, 1) so that the quadrant lookups never run off the edge
+    u = clamp((cos_theta + 1) / 2, 0.0, 0.999999999);
+    v = clamp(phi / (2 * pi), 0.0, 0.999999999);
+}
+
+inline vec3 square_to_direction(double u, double v) {
+    auto cos_theta = 2 * u - 1;
+    auto sin_theta = sqrt(fmax(0.0, 1 - cos_theta * cos_theta));
+    auto phi = 2 * pi * v;
+    return vec3(sin_theta * cos(phi), sin_theta * sin(phi), cos_theta);
+}
+
+// Quadrant of (u, v) in the unit square, then (u, v) rescaled into that quadrant
+inline int descend_quadrant(double& u, double& v) {
+    int q = 0;
+    u *= 2;
+    v *= 2;
+    if (u >= 1) {
+        q |= 1;
+        u -= 1;
+    }
+    if (v >= 1) {
+        q |= 2;
+        v -= 1;
+    }
+    return q;
+}
+
+struct quad_node {
+    // Energy that arrived through each quadrant, quadrant q is
+    // (q & 1) along u and (q >> 1) along v
+    std::atomic<double> sum[4];
+    // Node index of each quadrant's children, 0 when the quadrant is a leaf
+    uint32_t child[4];
+
+    quad_node() {
+        for (int q = 0; q < 4; q++) {
+            sum[q] = 0;
+            child[q] = 0;
+        }
+    }
+
+    // Only ever copied while nobody is recording
+    quad_node(const quad_node& other) {*this = other;}
+    quad_node& operator=(const quad_node& other) {
+        for (int q = 0; q < 4; q++) {
+            sum[q] = other.sum[q].load(std::memory_order_relaxed);
+            child[q] = other.child[q];
+        }
+        return *this;
+    }
+
+    double total() const {return sum[0] + sum[1] + sum[2] + sum[3];}
+};
+
+// Distribution of incoming light over the sphere of directions
+class direction_tree {
+    public:
+        // nodes[0] is the root
+        std::vector<quad_node> nodes;
+        std::atomic<unsigned long long> records{0};
+
+    public:
+        direction_tree() : nodes(1) {}
+        direction_tree(const direction_tree& other) {*this = other;}
+        direction_tree& operator=(const direction_tree& other) {
+            // A fresh copy, assigning over the old nodes would keep their capacity
+            nodes = std::vector<quad_node>(other.nodes);
+            records = other.records.load(std::memory_order_relaxed);
+            return *this;
+        }
+
+        // Thread-safe, adds `value` to every quadrant along the way to `direction`
+        void record(const vec3& direction, double value) {
+            records.fetch_add(1, std::memory_order_relaxed);
+            if (!(value > 0) || !std::isfinite(value))
+                return;
+
+            double u, v;
+            direction_to_square(direction, u, v);
+            uint32_t n = 0;
+            while (true) {
+                int q = descend_quadrant(u, v);
+                atomic_add(nodes[n].sum[q], value);
+                if (nodes[n].child[q] == 0)
+                    return;
+                n = nodes[n].child[q];
+            }
+        }
+
+        vec3 sample() const {
+            // Nothing learned yet, every direction is as likely as the other
+            if (nodes[0].total() <= 0)
+                return square_to_direction(random_double(), random_double());
+
+            double u = 0, v = 0, size = 1;
+            uint32_t n = 0;
+            while (true) {
+                const auto& node = nodes[n];
+                // Pick a quadrant in proportion to its energy
+                auto target = random_double() * node.total();
+                int q = 0;
+                while (q < 3 && target >= node.sum[q]) {
+                    target -= node.sum[q];
+                    q++;
+                }
+                // Skip over empty trailing quadrants that rounding can land on
+                while (q > 0 && node.sum[q] <= 0)
+                    q--;
+
+                size /= 2;
+                u += size * (q & 1);
+                v += size * (q >> 1);
+                if (node.child[q] == 0)
+                    break;
+                n = node.child[q];
+            }
+
+            return square_to_direction(u + size * random_double(), v + size * random_double());
+        }
+
+        // Density of sample() over the sphere of directions
+        double pdf(const vec3& direction) const {
+            if (nodes[0].total() <= 0)
+                return 1 / (4 * pi);
+
+            double u, v;
+            direction_to_square(direction, u, v);
+            double density = 1;
+            uint32_t n = 0;
+            while (true) {
+                const auto& node = nodes[n];
+                int q = descend_quadrant(u, v);
+                auto total = node.total();
+                if (total <= 0 || node.sum[q] <= 0)
+                    return 0;
+                density *= 4 * node.sum[q] / total;
+                if (node.child[q] == 0)
+                    break;
+                n = node.child[q];
+            }
+
+            return density / (4 * pi);
+        }
+
+        // Rebuild as an empty tree shaped after the energy learned in `energy`:
+        // every quadrant holding more than `threshold` of the total is split,
+        // the rest stay (or become) leaves. Never holds more than `max_nodes`
+        // nodes of memory, not even while it grows.
+        void rebuild(const direction_tree& energy, double threshold, size_t max_nodes) {
+            const int max_depth = 20;
+
+            struct pending {
+                uint32_t node;
+                // Matching node in `energy`, -1 below its leaves
+                int64_t old_node;
+                double old_energy;
+                int depth;
+            };
+
+            nodes.clear();
+            nodes.shrink_to_fit();
+            nodes.emplace_back();
+            records = 0;
+
+            auto total = energy.nodes[0].total();
+            if (total <= 0)
+                return;
+
+            // Growing by doubling could take up to twice what the tree needs
+            nodes.reserve(max_nodes);
+
+            std::vector<pending> queue{{0, 0, total, 1}};
+            for (size_t k = 0; k < queue.size(); k++) {
+                auto current = queue[k];
+                for (int q = 0; q < 4; q++) {
+                    // Below the leaves of the old tree the energy is assumed to be spread evenly
+                    double quadrant_energy = current.old_node >= 0
+                        ? energy.nodes[current.old_node].sum[q].load()
+                        : current.old_energy / 4;
+
+                    if (quadrant_energy / total <= threshold || current.depth >= max_depth
+                        || nodes.size() >= max_nodes)
+                        continue;
+
+                    auto child = static_cast<uint32_t>(nodes.size());
+                    nodes.emplace_back();
+                    nodes[current.node].child[q] = child;
+
+                    int64_t old_child = -1;
+                    if (current.old_node >= 0 && energy.nodes[current.old_node].child[q] != 0)
+                        old_child = energy.nodes[current.old_node].child[q];
+                    queue.push_back({child, old_child, quadrant_energy, current.depth + 1});
+                }
+            }
+            nodes.shrink_to_fit();
+        }
+};
+
+// What one spatial region has learned, sampling is frozen for the current pass
+// while building collects the records of the pass
+struct guiding_leaf {
+    direction_tree sampling;
+    direction_tree building;
+};
+
+struct spatial_node {
+    aabb box;
+    // Split axis, -1 for a leaf
+    int axis = -1;
+    double split = 0;
+    uint32_t child[2] = {0, 0};
+    // Index into the leaves, only for leaves
+    uint32_t leaf = 0;
+};
+
+class guiding_tree {
+    public:
+        std::vector<spatial_node> nodes;
+        std::vector<guiding_leaf> leaves;
+        // Upper bound on memory_used(), refinement stops splitting at this point
+        size_t memory_budget;
+        // Chance of sampling the material instead of the learned distribution
+        double bsdf_fraction;
+        // Records a leaf needs before it is split in two, grows with every pass
+        // like the sample count does
+        double spatial_threshold = 4000;
+        // Fraction of a leaf's energy a quadrant needs before it is split
+        double directional_threshold = 0.01;
+        int passes = 0;
+
+    public:
+        guiding_tree(const aabb& bounds, size_t budget, double fraction = 0.5)
+            : memory_budget(budget), bsdf_fraction(fraction) {
+            spatial_node root;
+            root.box = bounds;
+            nodes.push_back(root);
+            leaves.emplace_back();
+        }
+
+        // Thread-safe, points outside of the bounds go to the nearest leaf
+        guiding_leaf& leaf(const point3& p) {
+            uint32_t n = 0;
+            while (nodes[n].axis >= 0)
+                n = nodes[n].child[p[nodes[n].axis] < nodes[n].split ? 0 : 1];
+            return leaves[nodes[n].leaf];
+        }
+
+        // What is allocated, not just what is in use
+        size_t memory_used() const {
+            size_t bytes = nodes.capacity() * sizeof(spatial_node)
+                           + leaves.capacity() * sizeof(guiding_leaf);
+            for (const auto& l : leaves)
+                bytes += (l.sampling.nodes.capacity() + l.building.nodes.capacity()) * sizeof(quad_node);
+            return bytes;
+        }
+
+        // Call between passes while nobody is recording or sampling
+        void refine();
+};
+
+void guiding_tree::refine() {
+    passes++;
+
+    // What was just learned is what the next pass samples from
+    for (auto& l : leaves)
+        l.sampling = l.building;
+
+    // Split the regions that saw enough records in two, along their longest axis
+    auto threshold = spatial_threshold * sqrt(pow(2.0, passes));
+    auto count = nodes.size();
+    for (size_t n = 0; n < count; n++) {
+        if (nodes[n].axis >= 0)
+            continue;
+
+        auto& l = leaves[nodes[n].leaf];
+        auto cost = 2 * sizeof(spatial_node) + sizeof(guiding_leaf)
+                    + 2 * l.sampling.nodes.capacity() * sizeof(quad_node);
+        if (l.sampling.records < threshold || memory_used() + cost > memory_budget)
+            continue;
+
+        auto box = nodes[n].box;
+        auto extent = box.max() - box.min();
+        int axis = 0;
+        if (extent.y() > extent[axis])
+            axis = 1;
+        if (extent.z() > extent[axis])
+            axis = 2;
+        auto split = 0.5 * (box.min()[axis] + box.max()[axis]);
+
+        spatial_node lower, upper;
+        lower.box = upper.box = box;
+        lower.box.maximum[axis] = split;
+        upper.box.minimum[axis] = split;
+        // Both halves start out with what the whole region learned
+        lower.leaf = nodes[n].leaf;
+        upper.leaf = static_cast<uint32_t>(leaves.size());
+        leaves.push_back(leaves[nodes[n].leaf]);
+
+        nodes[n].axis = axis;
+        nodes[n].split = split;
+        nodes[n].child[0] = static_cast<uint32_t>(nodes.size());
+        nodes[n].child[1] = static_cast<uint32_t>(nodes.size() + 1);
+        nodes.push_back(lower);
+        nodes.push_back(upper);
+    }
+
+    // The splits grew both vectors by doubling
+    nodes.shrink_to_fit();
+    leaves.shrink_to_fit();
+
+    // Share whatever memory is left between the new building trees
+    size_t used = nodes.capacity() * sizeof(spatial_node) + leaves.capacity() * sizeof(guiding_leaf);
+    for (const auto& l : leaves)
+        used += l.sampling.nodes.capacity() * sizeof(quad_node);
+    size_t left = memory_budget > used ? memory_budget - used : 0;
+    size_t max_nodes = left / (leaves.size() * sizeof(quad_node));
+    if (max_nodes < 1)
+        max_nodes = 1;
+
+    // Let go of the old building trees first, so that rebuilding one leaf at
+    // a time never holds more than the budget
+    for (auto& l : leaves)
+        std::vector<quad_node>().swap(l.building.nodes);
+    for (auto& l : leaves)
+        l.building.rebuild(l.sampling, directional_threshold, max_nodes);
+}
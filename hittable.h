@@ -1,6 +1,9 @@
 #pragma once
 
+#include <vector>
+
 #include "ray.h"
+#include "aabb.h"
 
 class material;
 
@@ -22,4 +25,8 @@ struct hit_record {
 class hittable {
     public:
         virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const = 0;
+        // Returns false for unbounded objects (planes), those are kept out of the bvh
+        virtual bool bounding_box(aabb& output_box) const = 0;
+        // Append every material used by the object, duplicates are fine
+        virtual void collect_materials(std::vector<shared_ptr<material>>& out) const = 0;
 };
@@ -20,6 +20,12 @@ class hittable_list : public hittable {
 
         virtual bool hit(
                 const ray& r, double t_min, double t_max, hit_record& rec) const override;
+        virtual bool bounding_box(aabb& output_box) const override;
+
+        virtual void collect_materials(std::vector<shared_ptr<material>>& out) const override {
+            for (const auto& object : objects)
+                object->collect_materials(out);
+        }
 };
 
 // Method to check if, given a ray, if there are any objects that intersect with the ray
@@ -38,3 +44,21 @@ bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& re
 
     return hit_anything;
 }
+
+bool hittable_list::bounding_box(aabb& output_box) const {
+    if (objects.empty())
+        return false;
+
+    aabb temp_box;
+    bool first_box = true;
+
+    for (const auto& object : objects) {
+        // One unbounded object makes the whole list unbounded
+        if (!object->bounding_box(temp_box))
+            return false;
+        output_box = first_box ? temp_box : surrounding_box(output_box, temp_box);
+        first_box = false;
+    }
+
+    return true;
+}
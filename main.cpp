@@ -1,17 +1,34 @@
+#include <atomic>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
 
+#include "raytracor.h"
 #include "rt.h"
 #include "color.h"
-#include "hittable_list.h"
-#include "sphere.h"
-#include "camera.h"
-#include "material.h"
 
-hittable_list random_scene_three_cubes() {
-    hittable_list world;
+// Everything below builds its scene through libraytracor, vec3 from rt.h is
+// only used for the arithmetic, color.h for writing the image
+rt_vec3 to_rt(const vec3& v) {
+    return rt_vec3{v.x(), v.y(), v.z()};
+}
+
+// The ground used to be a sphere of radius 1000 just below y = 0, which
+// loses most of its precision in sphere::hit and needs t_min to hide its
+// acne, bounces off the plane never hit it again
+void add_ground(rt_scene* world, int ground_material, bool sphere_ground) {
+    if (sphere_ground)
+        rt_scene_add_sphere(world, to_rt(point3(0, -1000, 0)), 1000, ground_material);
+    else
+        rt_scene_add_plane(world, to_rt(point3(0, 0, 0)), to_rt(vec3(0, 1, 0)), ground_material);
+}
 
-    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+void random_scene_three_cubes(rt_scene* world, bool sphere_ground) {
+    auto ground_material = rt_scene_add_lambertian(world, to_rt(color(0.5, 0.5, 0.5)));
+    add_ground(world, ground_material, sphere_ground);
 
     for (int a = -3; a < 3; a++) {
         for (int b = -3; b < 3; b++) {
@@ -20,134 +37,401 @@ hittable_list random_scene_three_cubes() {
                           b + 0.9 * random_double());
 
             if ((center - point3(4, 0.2, 0)).length() > 0.9) {
-                shared_ptr<material> sphere_material;
+                int sphere_material;
 
                 // 80% chance of a diffuse
                 if (choose_mat < 0.8) {
                     // diffuse
                     auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                    sphere_material = rt_scene_add_lambertian(world, to_rt(albedo));
+                    rt_scene_add_sphere(world, to_rt(center), 0.2, sphere_material);
                 } else if (choose_mat < 0.95) { // 15% chance of a metal
                     // metal
                     auto albedo = color::random(0.5, 1);
                     auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                    sphere_material = rt_scene_add_metal(world, to_rt(albedo), fuzz);
+                    rt_scene_add_sphere(world, to_rt(center), 0.2, sphere_material);
                 } else { // 5% chance of glass
                     // glass
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                    sphere_material = rt_scene_add_dielectric(world, 1.5);
+                    rt_scene_add_sphere(world, to_rt(center), 0.2, sphere_material);
                 }
             }
         }
     }
 
-    auto material_dielectric = make_shared<dielectric>(1.5);
-    auto material_lambertian = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    auto material_metal      = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+    auto material_dielectric = rt_scene_add_dielectric(world, 1.5);
+    auto material_lambertian = rt_scene_add_lambertian(world, to_rt(color(0.4, 0.2, 0.1)));
+    auto material_metal      = rt_scene_add_metal(world, to_rt(color(0.7, 0.6, 0.5)), 0.0);
+
+    rt_scene_add_sphere(world, to_rt(point3(0, 1, 0)), 1.0, material_dielectric);
+    rt_scene_add_sphere(world, to_rt(point3(-4, 1, 0)), 1.0, material_lambertian);
+    rt_scene_add_sphere(world, to_rt(point3(4, 1, 0)), 1.0, material_metal);
+}
+
+void random_scene_small(rt_scene* world, bool sphere_ground) {
+    // Materials, numbered in the order they are added: the ground is 0 and
+    // the sphere 1
+    // auto material_dielectric = rt_scene_add_dielectric(world, 1.5);
+    auto material_lambertian_ground = rt_scene_add_lambertian(world, to_rt(color(0.1, 0.1, 0.1)));
+    auto material_lambertian = rt_scene_add_lambertian(world, to_rt(color(0.8, 0.1, 0.1)));
+    // auto material_metal      = rt_scene_add_metal(world, to_rt(color(0.7, 0.6, 0.5)), 0.0);
 
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material_dielectric));
-    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material_lambertian));
-    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material_metal));
+    add_ground(world, material_lambertian_ground, sphere_ground);
+    rt_scene_add_sphere(world, to_rt(point3(0, 1, 0)), 1.0, material_lambertian);
+}
+
+// Nothing but the ground under the sky, shows whether the ground is free of
+// acne when rendered with --t-min 0
+void ground_scene(rt_scene* world, bool sphere_ground) {
+    auto material_ground = rt_scene_add_lambertian(world, to_rt(color(0.5, 0.5, 0.5)));
+    add_ground(world, material_ground, sphere_ground);
+}
 
-    return world;
+// The small scene shut inside a room, the only light comes in through a
+// window in the ceiling so almost all of it is indirect
+void room_scene(rt_scene* world, bool sphere_ground) {
+    random_scene_small(world, sphere_ground);
+
+    auto material_wall = rt_scene_add_lambertian(world, to_rt(color(0.7, 0.7, 0.7)));
+
+    // Walls
+    rt_scene_add_rect(world, RT_AXIS_X, 0, 8, -15, 15, -15, material_wall);
+    rt_scene_add_rect(world, RT_AXIS_X, 0, 8, -15, 15, 15, material_wall);
+    rt_scene_add_rect(world, RT_AXIS_Z, -15, 15, 0, 8, -15, material_wall);
+    rt_scene_add_rect(world, RT_AXIS_Z, -15, 15, 0, 8, 15, material_wall);
+    // Ceiling around a window over x in [-3, 3], z in [-3, 3]
+    rt_scene_add_rect(world, RT_AXIS_Y, -15, -3, -15, 15, 8, material_wall);
+    rt_scene_add_rect(world, RT_AXIS_Y, 3, 15, -15, 15, 8, material_wall);
+    rt_scene_add_rect(world, RT_AXIS_Y, -3, 3, -15, -3, 8, material_wall);
+    rt_scene_add_rect(world, RT_AXIS_Y, -3, 3, 3, 15, 8, material_wall);
 }
 
-hittable_list random_scene_small() {
-    hittable_list world;
+// One of every analytic primitive besides the sphere, the cylinder and the
+// disk tilted so that their hits don't line up with an axis
+void shapes_scene(rt_scene* world, bool sphere_ground) {
+    auto material_ground = rt_scene_add_lambertian(world, to_rt(color(0.5, 0.5, 0.5)));
+    auto material_box = rt_scene_add_lambertian(world, to_rt(color(0.1, 0.2, 0.5)));
+    auto material_cylinder = rt_scene_add_metal(world, to_rt(color(0.7, 0.6, 0.5)), 0.1);
+    auto material_tilted = rt_scene_add_lambertian(world, to_rt(color(0.2, 0.6, 0.2)));
+    auto material_disk = rt_scene_add_lambertian(world, to_rt(color(0.8, 0.1, 0.1)));
+
+    add_ground(world, material_ground, sphere_ground);
+    rt_scene_add_box(world, to_rt(point3(-3.5, 0, -2)), to_rt(point3(-1.5, 2, 0)), material_box);
+    rt_scene_add_cylinder(world, to_rt(point3(0, 0, -1)), to_rt(vec3(0, 1, 0)), 0.8, 1.5,
+                          material_cylinder);
+    rt_scene_add_cylinder(world, to_rt(point3(1.5, 0.4, -2.5)), to_rt(vec3(1, 1, 0)), 0.4, 1.5,
+                          material_tilted);
+    rt_scene_add_disk(world, to_rt(point3(2, 1, 1)), to_rt(vec3(1, 0.3, 0.2)), 0.9, material_disk);
+}
+
+// Parse "r,g,b"
+color parse_color(const std::string& value) {
+    color c;
+    size_t start = 0;
+    for (int a = 0; a < 3; a++) {
+        auto end = value.find(',', start);
+        c[a] = std::stod(value.substr(start, end - start));
+        start = end + 1;
+    }
+    return c;
+}
 
-    // Materials
-    // auto material_dielectric = make_shared<dielectric>(1.5);
-    auto material_lambertian = make_shared<lambertian>(color(0.8, 0.1, 0.1));
-    auto material_lambertian_ground = make_shared<lambertian>(color(0.1, 0.1, 0.1));
-    // auto material_metal      = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+// Apply a look-dev edit, "ID:KEY=VALUE" for material ID or "sky:KEY=VALUE".
+// The library notes what changed for the next render. Returns false if the
+// edit makes no sense.
+bool apply_edit(rt_scene* world, const std::string& edit, color& sky_horizon, color& sky_zenith) {
+    auto colon = edit.find(':');
+    auto equals = edit.find('=');
+    if (colon == std::string::npos || equals == std::string::npos || equals < colon)
+        return false;
+
+    auto target = edit.substr(0, colon);
+    auto key = edit.substr(colon + 1, equals - colon - 1);
+    auto value = edit.substr(equals + 1);
+
+    if (target == "sky") {
+        if (key == "horizon")
+            sky_horizon = parse_color(value);
+        else if (key == "zenith")
+            sky_zenith = parse_color(value);
+        else
+            return false;
+        return rt_scene_set_sky(world, to_rt(sky_horizon), to_rt(sky_zenith)) == RT_OK;
+    }
 
-    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, material_lambertian_ground));
-    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material_lambertian));
+    int id = std::stoi(target);
+    if (key == "albedo")
+        return rt_material_set_albedo(world, id, to_rt(parse_color(value))) == RT_OK;
+    if (key == "fuzz")
+        return rt_material_set_fuzz(world, id, std::stod(value)) == RT_OK;
+    if (key == "ir")
+        return rt_material_set_ir(world, id, std::stod(value)) == RT_OK;
+    return false;
+}
 
-    return world;
+void write_materials(std::ostream& out, const rt_scene* world) {
+    for (int id = 0; id < rt_scene_material_count(world); id++) {
+        rt_material_info info;
+        rt_scene_material_info(world, id, &info);
+        vec3 albedo(info.albedo.x, info.albedo.y, info.albedo.z);
+        out << "Material " << id << ": ";
+        if (info.type == RT_LAMBERTIAN)
+            out << "lambertian albedo=" << albedo;
+        else if (info.type == RT_METAL)
+            out << "metal albedo=" << albedo << " fuzz=" << info.fuzz;
+        else if (info.type == RT_DIELECTRIC)
+            out << "dielectric ir=" << info.ir;
+        out << '\n';
+    }
 }
 
-color ray_color(const ray& r, const hittable& world, int depth) {
-    // Create a temporary hit_record
-    hit_record rec;
+void write_render_stats(std::ostream& out, const rt_scene* world) {
+    rt_render_stats stats;
+    rt_render_stats_get(world, &stats);
+
+    for (int n = 0; n < stats.nodes; n++) {
+        rt_node_stats s;
+        rt_node_stats_get(world, n, &s);
+        double seconds = s.seconds > 0 ? s.seconds : 1;
+        out << "Node " << n << ": "
+            << s.threads << " threads, "
+            << s.tiles << " tiles (" << s.stolen << " stolen), "
+            << s.seconds << "s, "
+            << s.samples / seconds / 1e6 << " Msamples/s, "
+            << s.rays / seconds / 1e6 << " Mrays/s\n";
+    }
+
+    if (stats.unpinned > 0) {
+        out << "Warning: " << stats.unpinned << " threads could not be pinned to their numa node, "
+            << "their memory may be on another node\n";
+    }
 
-    // If exceeded ray bounce limit, don't generate anymore light
-    if (depth <= 0) {
-        return color(0, 0, 0);
+    if (stats.guiding_memory > 0) {
+        out << "Guiding: " << stats.passes << " passes, "
+            << stats.guiding_memory / 1024 << " KiB\n";
     }
 
-    // If the world hits anything at the current ray, rec will be modified
-    // with the appropriate values
-    // Change 0 to 0.001 as t_min can be ~0.000000001 - shadow acne
-    // https://digitalrune.github.io/DigitalRune-Documentation/html/3f4d959e-9c98-4a97-8d85-7a73c26145d7.htm
-    if (world.hit(r, 0.001, infinity, rec)) {
-        ray scattered;
-        color attenuation;
+    if (stats.cache_over_budget > 0) {
+        out << "Primary cache: needs " << stats.cache_over_budget / (1024 * 1024)
+            << " MiB, over the --cache-memory budget, edits re-render from scratch\n";
+    }
 
-        // Note : These are abstracted into materials
-        // Uniform scatter direction???
-        // point3 target = rec.p + random_in_hemisphere(rec.normal);
-        // Lambertian diffuse
-        // https://en.wikipedia.org/wiki/Lambertian_reflectance
-        // point3 target = rec.p + rec.normal + random_unit_vector();
-        // return 0.5 * ray_color(ray(rec.p, target - rec.p), world, depth - 1);
+    if (stats.cache_memory > 0) {
+        out << "Primary cache: " << stats.cache_memory / 1024 << " KiB, "
+            << stats.pixels_skipped << " of " << stats.pixels << " pixels skipped\n";
+    }
 
-        if (rec.mat_ptr->scatter(r, rec, attenuation, scattered)) {
-            return attenuation * ray_color(scattered, world, depth - 1);
-        }
+    // Variance times render time is constant for a given method, the ratio of
+    // it between two renders is their error ratio at equal time
+    out << "Error: mean pixel variance " << stats.mean_variance
+        << ", " << stats.seconds << "s, "
+        << "variance x time " << stats.mean_variance * stats.seconds << '\n';
+}
 
-        return color(0, 0, 0);
+// Linear rgb floats, top row first, as a little endian PFM (which is bottom
+// row first)
+bool write_pfm(const std::string& path, const std::vector<float>& pixels, int width, int height) {
+    std::ofstream out(path, std::ios::binary);
+    out << "PF\n" << width << ' ' << height << "\n-1.0\n";
+    for (int j = height - 1; j >= 0; --j) {
+        out.write(reinterpret_cast<const char*>(&pixels[static_cast<size_t>(j) * width * 3]),
+                  static_cast<std::streamsize>(width * 3 * sizeof(float)));
+    }
+    return static_cast<bool>(out);
+}
 
+bool read_pfm(const std::string& path, std::vector<float>& pixels, int& width, int& height) {
+    std::ifstream in(path, std::ios::binary);
+    std::string magic;
+    double scale;
+    in >> magic >> width >> height >> scale;
+    in.get();
+    // Only little endian rgb, what write_pfm writes
+    if (!in || magic != "PF" || scale >= 0 || width <= 0 || height <= 0)
+        return false;
+
+    pixels.resize(static_cast<size_t>(width) * height * 3);
+    for (int j = height - 1; j >= 0; --j) {
+        in.read(reinterpret_cast<char*>(&pixels[static_cast<size_t>(j) * width * 3]),
+                static_cast<std::streamsize>(width * 3 * sizeof(float)));
     }
+    return static_cast<bool>(in);
+}
 
-    // Get unit vector of the ray
-    vec3 unit_direction = unit_vector(r.direction());
-    // unit_direction.y() as this is a gradient based on the y-axis
-    auto t = 0.5 * (unit_direction.y() + 1.0);
+// Compare the render against a reference with many more samples. The mean
+// squared error sees bias that the variance estimate cannot, and the image
+// means have to agree within noise: the standard error of the image mean
+// is sqrt(mean pixel variance / pixels), the reference's own noise is left
+// out. Returns false if they are more than max_sigma standard errors apart.
+bool compare_to_reference(std::ostream& out, const rt_scene* world, const std::vector<float>& pixels,
+                          const std::vector<float>& reference, double max_sigma) {
+    rt_render_stats stats;
+    rt_render_stats_get(world, &stats);
+
+    double squared_error = 0, mean = 0, reference_mean = 0;
+    for (size_t k = 0; k < stats.pixels; k++) {
+        auto l = luminance(color(pixels[k * 3], pixels[k * 3 + 1], pixels[k * 3 + 2]));
+        auto r = luminance(color(reference[k * 3], reference[k * 3 + 1], reference[k * 3 + 2]));
+        squared_error += (l - r) * (l - r);
+        mean += l;
+        reference_mean += r;
+    }
+    auto mse = squared_error / stats.pixels;
+    mean /= stats.pixels;
+    reference_mean /= stats.pixels;
+    auto standard_error = sqrt(stats.mean_variance / stats.pixels);
+    auto sigma = standard_error > 0 ? (mean - reference_mean) / standard_error : 0;
+
+    // Like variance x time, MSE x time is the error ratio at equal time
+    out << "Reference: MSE " << mse << ", MSE x time " << mse * stats.seconds
+        << ", mean " << mean << " against " << reference_mean
+        << " (" << sigma << " standard errors)\n";
+    if (fabs(sigma) > max_sigma) {
+        out << "Mean is off the reference by more than " << max_sigma << " standard errors\n";
+        return false;
+    }
+    return true;
+}
 
-    // When t = 1.0 - Get blue value
-    // When t = 0.0 - Get white value
-    // Linearly interpolate between the values through the height
-    // If the value is between 0.0 and 1.0, then this will 'mix' the colors
-    return (1.0 - t) * color(1.0, 1.0, 1.0)  // if 1.0, this negates the 'white' vlaue
-            + t * color(0.5, 0.7, 1.0);      // this is the blue value
+// Tile callback, prints how far the render got. Every pass goes over all of
+// the tiles once.
+struct progress {
+    int tiles_per_pass;
+    std::atomic<int> done{0};
+    std::mutex mutex;
+
+    static int report(void* user, int, int, int, int) {
+        auto p = static_cast<progress*>(user);
+        auto done = p->done.fetch_add(1) + 1;
+        auto left = p->tiles_per_pass - (done - 1) % p->tiles_per_pass - 1;
+        if (done % 16 == 0 || left == 0) {
+            std::lock_guard<std::mutex> lock(p->mutex);
+            std::cerr << "\rPass " << (done - 1) / p->tiles_per_pass + 1
+                      << ", Tiles Remaining: " << left << ' ' << std::flush;
+        }
+        return 0;
+    }
+};
+
+void usage(const char* name) {
+    std::cerr << "Usage: " << name << " [options] > image.ppm\n"
+              << "  --width N                 image width, default 1920\n"
+              << "  --spp N                   samples per pixel, default 50\n"
+              << "  --scene NAME              small (default), three-cubes, room, shapes\n"
+              << "                            or ground\n"
+              << "  --ground plane|sphere     exact plane (default) or the old 1000 radius sphere\n"
+              << "  --t-min T                 closest hit accepted along a ray, default 0.001\n"
+              << "  --guiding                 learn the incoming light and guide diffuse bounces\n"
+              << "  --guiding-memory MB       memory budget of the guiding, default 16\n"
+              << "  --edit ID:KEY=VALUE       after rendering, edit a material and re-render from\n"
+              << "                            the cached first hits, e.g. 1:albedo=0.1,0.8,0.1,\n"
+              << "                            2:fuzz=0.3, 3:ir=1.3 or sky:zenith=1,0.6,0.3.\n"
+              << "                            Can be given more than once, one re-render each\n"
+              << "  --cache-memory MB         memory budget of the --edit first hit cache, 40\n"
+              << "                            bytes a sample, default 1024\n"
+              << "  --write-pfm FILE          also write the linear image as a PFM\n"
+              << "  --reference FILE          compare against the PFM of a render with many more\n"
+              << "                            samples, exits with 2 if the means disagree\n"
+              << "  --threads N               worker threads, default one per cpu\n"
+              << "  --numa                    pin workers per numa node, node-local tile queues\n"
+              << "  --numa-fake N             like --numa, with N pretend nodes (for testing)\n"
+              << "  --numa-placement MODE     replicate (default) or interleave the scene\n";
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     // Image dimensions, 16:9 aspect ratio, calculate width & height
     const auto aspect_ratio = 16.0 / 9.0;
-    const int image_width = 1920;
-    const int image_height = static_cast<int>(image_width / aspect_ratio);
+    int image_width = 1920;
     // Previously 100
-    const int samples_per_pixel = 50;
+    int samples_per_pixel = 50;
     // So that it ray_color doesn't try to bounce limitlessly and segfault
     const int max_depth = 15;
 
+    rt_render_options options;
+    rt_render_options_init(&options);
+    bool sphere_ground = false;
+    std::string scene = "small";
+    std::vector<std::string> edits;
+    std::string pfm_path;
+    std::string reference_path;
+
+    for (int k = 1; k < argc; k++) {
+        bool has_value = k + 1 < argc;
+        if (!strcmp(argv[k], "--width") && has_value) {
+            image_width = std::stoi(argv[++k]);
+        } else if (!strcmp(argv[k], "--spp") && has_value) {
+            samples_per_pixel = std::stoi(argv[++k]);
+        } else if (!strcmp(argv[k], "--scene") && has_value) {
+            scene = argv[++k];
+            if (scene != "small" && scene != "three-cubes" && scene != "room"
+                && scene != "shapes" && scene != "ground") {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[k], "--ground") && has_value) {
+            std::string ground = argv[++k];
+            if (ground != "plane" && ground != "sphere") {
+                usage(argv[0]);
+                return 1;
+            }
+            sphere_ground = ground == "sphere";
+        } else if (!strcmp(argv[k], "--t-min") && has_value) {
+            options.t_min = std::stod(argv[++k]);
+        } else if (!strcmp(argv[k], "--guiding")) {
+            options.guiding = 1;
+        } else if (!strcmp(argv[k], "--cache-memory") && has_value) {
+            options.cache_memory = std::stoul(argv[++k]) * 1024 * 1024;
+        } else if (!strcmp(argv[k], "--guiding-memory") && has_value) {
+            options.guiding_memory = std::stoul(argv[++k]) * 1024 * 1024;
+        } else if (!strcmp(argv[k], "--edit") && has_value) {
+            edits.push_back(argv[++k]);
+        } else if (!strcmp(argv[k], "--write-pfm") && has_value) {
+            pfm_path = argv[++k];
+        } else if (!strcmp(argv[k], "--reference") && has_value) {
+            reference_path = argv[++k];
+        } else if (!strcmp(argv[k], "--threads") && has_value) {
+            options.threads = std::stoi(argv[++k]);
+        } else if (!strcmp(argv[k], "--numa")) {
+            options.numa = 1;
+        } else if (!strcmp(argv[k], "--numa-fake") && has_value) {
+            options.numa_fake_nodes = std::stoi(argv[++k]);
+        } else if (!strcmp(argv[k], "--numa-placement") && has_value) {
+            std::string mode = argv[++k];
+            if (mode == "replicate") {
+                options.numa_interleave = 0;
+            } else if (mode == "interleave") {
+                options.numa_interleave = 1;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    const int image_height = static_cast<int>(image_width / aspect_ratio);
+    options.width = image_width;
+    options.height = image_height;
+    options.samples_per_pixel = samples_per_pixel;
+    options.max_depth = max_depth;
+
     // World
-    // hittable_list world = random_scene_three_cubes();
-    hittable_list world = random_scene_small();
-
-    // auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-    // auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
-    // auto material_left   = make_shared<metal>(color(0.8, 0.8, 0.8), 0.0);
-    // auto material_center = make_shared<dielectric>(1.5);
-    // auto material_left   = make_shared<dielectric>(1.5);
-    // auto material_right  = make_shared<metal>(color(0.8, 0.6, 0.2), 0.5);
-
-    // "Ground" sphere - make it big enough to look like a ground of some sort
-    // world.add(make_shared<sphere>(point3(0.0, -100.5, -1.0), 100.0, material_ground));
-    // Center sphere
-    // world.add(make_shared<sphere>(point3(0.0, 0.0, -1.0), 0.5, material_center));
-    // Left sphere
-    // world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), 0.5, material_left));
-    // Another left sphere
-    // If given a negative radius, it will become a glass sphere
-    // Reflection will be similar to what it is like physically with a glass sphere
-    // world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), -0.4, material_left));
-    // Right sphere
-    // world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
+    // The random scenes come out the same on every run
+    raytracor::scene world;
+    seed_random(0);
+    if (scene == "three-cubes")
+        random_scene_three_cubes(world.handle, sphere_ground);
+    else if (scene == "room")
+        room_scene(world.handle, sphere_ground);
+    else if (scene == "shapes")
+        shapes_scene(world.handle, sphere_ground);
+    else if (scene == "ground")
+        ground_scene(world.handle, sphere_ground);
+    else
+        random_scene_small(world.handle, sphere_ground);
 
     point3 lookfrom(13, 3, 2);
     point3 lookat(0, 0, -1);
@@ -155,44 +439,86 @@ int main() {
     auto dist_to_focus = (lookfrom-lookat).length();
     auto aperture = 0.15;
 
-    // Camera - 90.0 vertical fov (degrees), 16:9 aspect ratio
-    camera cam(lookfrom,            // vec3 lookfrom
-               lookat,              // vec3 lookat
-               vup,                 // vec3 vertical up
-               20.0,                // vertical fov (degrees)
-               aspect_ratio,        // (most likely) 16:9 aspect ratio
-               aperture,
-               dist_to_focus);
+    // Camera - 20.0 vertical fov (degrees), the aspect ratio follows the image
+    rt_camera cam;
+    cam.lookfrom = to_rt(lookfrom);
+    cam.lookat = to_rt(lookat);
+    cam.vup = to_rt(vup);
+    cam.vfov = 20.0;
+    cam.aperture = aperture;
+    cam.focus_dist = dist_to_focus;
+    world.camera(cam);
+
+    // The library renders the linear average of every pixel straight into
+    // this, top row first
+    std::vector<float> pixels(static_cast<size_t>(image_width) * image_height * 3);
+    rt_framebuffer framebuffer{pixels.data(), 3, 0};
+
+    // Render the image, then once more after every edit. The library keeps
+    // the first hits of the render and re-renders only what an edit touched.
+    color sky_horizon(1.0, 1.0, 1.0);
+    color sky_zenith(0.5, 0.7, 1.0);
+    options.cache_primary = !edits.empty();
+    if (!edits.empty())
+        write_materials(std::cerr, world.handle);
+
+    auto tile_size = options.tile_size;
+    auto render = [&]() {
+        progress p;
+        p.tiles_per_pass = ((image_width + tile_size - 1) / tile_size)
+                           * ((image_height + tile_size - 1) / tile_size);
+        auto status = rt_render(world.handle, &options, &framebuffer, progress::report, &p);
+        if (status != RT_OK)
+            std::cerr << "\nRender failed: " << rt_status_string(status) << '\n';
+        return status == RT_OK;
+    };
+
+    if (!render())
+        return 1;
+    for (const auto& edit : edits) {
+        std::cerr << "\nDone.\n";
+        write_render_stats(std::cerr, world.handle);
+
+        if (!apply_edit(world.handle, edit, sky_horizon, sky_zenith)) {
+            std::cerr << "Cannot apply edit " << edit << '\n';
+            return 1;
+        }
+        std::cerr << "Edit " << edit << '\n';
+        if (!render())
+            return 1;
+    }
 
-    // Render the image
     std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
 
-    // Iterate over the amount of pixels (height)
-    // Starting from image_height-1, as it starts from the top-left
-    for (int j = image_height-1; j >= 0; --j) {
-        std::cerr << "\rScanlines Remaining: " << j << std::flush;
-        // Iterate over the amount of pixels (width)
+    for (int j = 0; j < image_height; ++j) {
         for (int i = 0; i < image_width; ++i) {
-            color pixel_color(0, 0, 0);
-            // Anti alias around the pixel
-            // Using random is to "move" the pixel around a 0-1 area
-            // Given enough times (samples_per_pixel), this will normalize out
-            // and 'antialias' on the pixel.
-            for (int s = 0; s < samples_per_pixel; ++s) {
-                // Convert to relative scales
-                auto u = (i + random_double()) / (image_width - 1);
-                auto v = (j + random_double()) / (image_height - 1);
-                // Get a ray from the camera
-                ray r = cam.get_ray(u, v);
-                // Get the colour
-                // Pass in max_depth first, as it will decrement as it recursively goes down
-                pixel_color += ray_color(r, world, max_depth);
-            }
-            write_color(std::cout, pixel_color, samples_per_pixel);
+            const float* pixel = &pixels[(static_cast<size_t>(j) * image_width + i) * 3];
+            // The pixels are already the average of their samples
+            write_color(std::cout, color(pixel[0], pixel[1], pixel[2]), 1);
         }
     }
 
     std::cerr << "\nDone.\n";
+    write_render_stats(std::cerr, world.handle);
+
+    if (!pfm_path.empty() && !write_pfm(pfm_path, pixels, image_width, image_height)) {
+        std::cerr << "Cannot write " << pfm_path << '\n';
+        return 1;
+    }
+
+    if (!reference_path.empty()) {
+        std::vector<float> reference;
+        int reference_width, reference_height;
+        if (!read_pfm(reference_path, reference, reference_width, reference_height)
+            || reference_width != image_width || reference_height != image_height) {
+            std::cerr << "Cannot read a " << image_width << 'x' << image_height
+                      << " reference from " << reference_path << '\n';
+            return 1;
+        }
+        // A 4 sigma miss happens by chance about once in 16000 renders
+        if (!compare_to_reference(std::cerr, world.handle, pixels, reference, 4))
+            return 2;
+    }
 
     return 0;
 }
@@ -6,10 +6,25 @@ struct hit_record;
 
 // Abstract material class, for individual materials to inherit out of
 class material {
+    public:
+        // Index of the material in its scene, given out by the render_session
+        // in the order the scene uses them, so replicas of a scene agree on it
+        int id = -1;
+
     public:
         virtual bool scatter(
                 const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
             ) const = 0;
+
+        // Diffuse materials can have their scatter direction picked by the path
+        // guiding instead, as long as they can tell how likely scatter() is to
+        // pick a given direction. attenuation * scattering_pdf is then the
+        // brdf times the cosine for that direction.
+        virtual bool is_diffuse() const {return false;}
+
+        virtual double scattering_pdf(const hit_record&, const vec3&) const {
+            return 0;
+        }
 };
 
 // Lambertian
@@ -33,6 +48,14 @@ class lambertian : public material {
             attenuation = albedo;
             return true;
         }
+
+        virtual bool is_diffuse() const override {return true;}
+
+        // normal + random_unit_vector() is cosine weighted
+        virtual double scattering_pdf(const hit_record& rec, const vec3& direction) const override {
+            auto cosine = dot(rec.normal, unit_vector(direction));
+            return cosine < 0 ? 0 : cosine / pi;
+        }
 };
 
 // Metal
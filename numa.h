@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// How the immutable scene data is placed across numa nodes
+enum class numa_placement {
+    // Every node builds its own copy of the scene from a thread pinned to it,
+    // first-touch then keeps the copy in that node's memory
+    replicate,
+    // A single copy of the scene with its pages spread round-robin across
+    // every node, halves the memory use of replicate at the cost of latency
+    interleave
+};
+
+class numa_topology {
+    public:
+        // cpus[n] holds the logical cpus that belong to node n
+        std::vector<std::vector<int>> cpus;
+        // ids[n] is the kernel's id for node n, ids can have holes in them
+        std::vector<int> ids;
+        // distance[n][m] is the kernel's relative cost for node n to reach the
+        // memory of node m, 10 for its own. Empty when unknown.
+        std::vector<std::vector<int>> distance;
+        // A fake topology splits the real cpus into pretend nodes, so that the
+        // numa code paths can be exercised on a single node machine
+        bool fake = false;
+
+    public:
+        int node_count() const {return static_cast<int>(cpus.size());}
+
+        // The other nodes, nearest first, ties and unknown distances go in
+        // ring order starting after `node`
+        std::vector<int> steal_order(int node) const;
+        // Share `threads` workers between the nodes by their number of cpus
+        std::vector<int> workers_per_node(int threads) const;
+
+        // Read the topology from sysfs, falls back to a single node. Only the
+        // cpus this process may run on count, nodes left without any are
+        // dropped, like under taskset or a cgroup cpuset.
+        static numa_topology detect();
+        // Split the cpus of this machine round-robin into `nodes` pretend nodes
+        static numa_topology fake_nodes(int nodes);
+        // Every cpu of this machine in one node
+        static numa_topology single_node();
+};
+
+// Parse a sysfs cpulist such as "0-3,8-11"
+inline std::vector<int> parse_cpulist(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n")
+            continue;
+        auto dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+// The cpus this process is allowed to run on, not every cpu in the box.
+// Empty when that cannot be found out.
+inline std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &set))
+                cpus.push_back(cpu);
+    }
+#endif
+    return cpus;
+}
+
+inline numa_topology numa_topology::single_node() {
+    numa_topology topology;
+    topology.cpus.push_back(allowed_cpus());
+    topology.ids.push_back(0);
+
+    if (topology.cpus[0].empty()) {
+        int count = static_cast<int>(std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < (count < 1 ? 1 : count); cpu++)
+            topology.cpus[0].push_back(cpu);
+    }
+
+    return topology;
+}
+
+inline numa_topology numa_topology::detect() {
+    numa_topology topology;
+    auto allowed = allowed_cpus();
+    // Every node, memory-only ones too, a distance row has a column for each
+    std::vector<int> all_ids;
+    std::vector<std::vector<int>> rows;
+
+    // Node ids can have holes in them (node0, node2), walk until a few misses in a row
+    for (int node = 0, misses = 0; misses < 8; node++) {
+        const auto dir = "/sys/devices/system/node/node" + std::to_string(node);
+        std::ifstream file(dir + "/cpulist");
+        if (!file) {
+            misses++;
+            continue;
+        }
+        misses = 0;
+        all_ids.push_back(node);
+
+        std::string list;
+        std::getline(file, list);
+        std::vector<int> cpus;
+        for (int cpu : parse_cpulist(list)) {
+            if (allowed.empty() || std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+                cpus.push_back(cpu);
+        }
+        // Memory-only nodes, and nodes this process may not run on, have no
+        // cpus to schedule workers on
+        if (!cpus.empty()) {
+            topology.cpus.push_back(cpus);
+            topology.ids.push_back(node);
+
+            std::ifstream distances(dir + "/distance");
+            std::vector<int> row;
+            for (int d; distances >> d;)
+                row.push_back(d);
+            rows.push_back(row);
+        }
+    }
+
+    if (topology.cpus.empty())
+        return single_node();
+
+    // Keep only the columns of the nodes that were kept, give up on the
+    // distances if any row does not line up with the nodes found
+    for (const auto& row : rows) {
+        if (row.size() != all_ids.size())
+            return topology;
+    }
+    for (const auto& row : rows) {
+        std::vector<int> kept;
+        for (int id : topology.ids)
+            kept.push_back(row[std::find(all_ids.begin(), all_ids.end(), id) - all_ids.begin()]);
+        topology.distance.push_back(kept);
+    }
+
+    return topology;
+}
+
+inline numa_topology numa_topology::fake_nodes(int nodes) {
+    auto machine = single_node().cpus[0];
+    numa_topology topology;
+    topology.fake = true;
+    topology.cpus.resize(nodes < 1 ? 1 : nodes);
+    for (int node = 0; node < topology.node_count(); node++)
+        topology.ids.push_back(node);
+
+    // When there are fewer cpus than nodes, nodes share cpus so that each of
+    // them still has at least one worker
+    int count = static_cast<int>(machine.size());
+    int slots = count > topology.node_count() ? count : topology.node_count();
+    for (int i = 0; i < slots; i++)
+        topology.cpus[i % topology.node_count()].push_back(machine[i % count]);
+
+    return topology;
+}
+
+inline std::vector<int> numa_topology::steal_order(int node) const {
+    std::vector<int> order;
+    for (int k = 1; k < node_count(); k++)
+        order.push_back((node + k) % node_count());
+
+    if (!distance.empty()) {
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return distance[node][a] < distance[node][b];
+        });
+    }
+    return order;
+}
+
+inline std::vector<int> numa_topology::workers_per_node(int threads) const {
+    // Largest remainder, every node gets its whole share of the workers and
+    // what is left over goes to the nodes that lost the most to rounding
+    size_t total = 0;
+    for (const auto& c : cpus)
+        total += c.size();
+
+    std::vector<int> workers(node_count());
+    std::vector<std::pair<size_t, int>> remainders;
+    int given = 0;
+    for (int n = 0; n < node_count(); n++) {
+        auto share = threads * cpus[n].size();
+        workers[n] = static_cast<int>(share / total);
+        given += workers[n];
+        remainders.push_back({share % total, n});
+    }
+    std::stable_sort(remainders.begin(), remainders.end(), [](const auto& a, const auto& b) {
+        return a.first > b.first;
+    });
+    for (int k = 0; given < threads; k++, given++)
+        workers[remainders[k % node_count()].second]++;
+
+    return workers;
+}
+
+// Restrict the calling thread to the given cpus, returns false if unsupported
+inline bool pin_thread_to_cpus(const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+// Interleave every allocation the calling thread makes from now on across all
+// real nodes, or go back to the default local policy when `enable` is false.
+// Talks to the kernel directly so there is no dependency on libnuma.
+inline bool interleave_thread_memory(const numa_topology& topology, bool enable) {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    // Pretend nodes all live in the same memory, there is nothing to interleave
+    if (topology.fake)
+        return false;
+
+    const int mpol_default = 0;
+    const int mpol_interleave = 3;
+
+    unsigned long mask = 0;
+    for (int id : topology.ids)
+        if (id < 64)
+            mask |= 1UL << id;
+
+    if (!enable)
+        return syscall(SYS_set_mempolicy, mpol_default, nullptr, 0) == 0;
+    return syscall(SYS_set_mempolicy, mpol_interleave, &mask, sizeof(mask) * 8) == 0;
+#else
+    (void)topology;
+    (void)enable;
+    return false;
+#endif
+}
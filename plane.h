@@ -0,0 +1,60 @@
+#pragma once
+
+#include "hittable.h"
+#include "vec3.h"
+
+// Infinite plane through `point` facing `normal`.
+// Hits are moved onto the plane, and a ray that starts on the plane can never
+// hit it again, so bounces off it need no t_min and it is the ground to use
+// instead of a huge sphere. Planes have no bounding box and are tested
+// outside of the bvh.
+class plane : public hittable {
+    public:
+        point3 point;
+        vec3 normal;
+        shared_ptr<material> mat_ptr;
+
+    public:
+        plane() {}
+        plane(point3 p, vec3 n, shared_ptr<material> m)
+            : point(p), normal(unit_vector(n)), mat_ptr(m) {};
+
+        virtual bool hit(
+                const ray& r, double t_min, double t_max, hit_record& rec) const override;
+        virtual bool bounding_box(aabb& output_box) const override;
+        virtual void collect_materials(std::vector<shared_ptr<material>>& out) const override {
+            out.push_back(mat_ptr);
+        }
+};
+
+bool plane::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    auto denom = dot(normal, r.direction());
+    // Parallel to the plane
+    if (denom == 0)
+        return false;
+
+    // Signed distance of the ray's origin from the plane. A flat surface
+    // cannot be hit twice in a row, so an origin that is on the plane up to
+    // rounding is a bounce off it and not a hit.
+    auto distance = dot(r.origin() - point, normal);
+    auto scale = fabs(dot(r.origin(), normal)) + fabs(dot(point, normal));
+    if (fabs(distance) <= 1e-12 * (1 + scale))
+        return false;
+
+    auto t = -distance / denom;
+    if (t < t_min || t_max < t)
+        return false;
+
+    rec.t = t;
+    // r.at(t) is off the plane by rounding, put it back on
+    rec.p = r.at(t);
+    rec.p = rec.p - dot(rec.p - point, normal) * normal;
+    rec.set_face_normal(r, normal);
+    rec.mat_ptr = mat_ptr;
+
+    return true;
+}
+
+bool plane::bounding_box(aabb&) const {
+    return false;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "rt.h"
+#include "hittable.h"
+
+// Everything a path needs from its first hit, so that a re-render after a
+// material or lighting edit can carry on from there instead of redoing the
+// first world.hit, 40 bytes a sample. The camera ray is cheap to make again.
+struct primary_sample {
+    // The bounce rays start here, a float position is off the surface by more
+    // than a small t_min and the path would hit its own surface again
+    double p[3];
+    // A float is plenty for the direction
+    float normal[3];
+    // Index of the material hit, no_hit when the sample went straight to the
+    // sky, with front_face in the top bit
+    uint32_t material;
+
+    static const uint32_t no_hit = 0x7fffffff;
+    static const uint32_t front_face_bit = 0x80000000;
+};
+
+// Bit of a material in the mask of what a pixel's paths have seen. Ids share
+// bits past 63 materials, which only ever re-renders a pixel too many.
+inline uint64_t material_bit(int id) {
+    return id < 0 ? 0 : uint64_t(1) << (id % 63);
+}
+
+// The sky has the last bit of its own
+const uint64_t background_bit = uint64_t(1) << 63;
+
+// What changed in the scene since the last render, for a re-render
+struct scene_change {
+    // Ids of the materials whose parameters were edited
+    std::vector<int> materials;
+    // The sky, the only light in these scenes, was changed
+    bool background = false;
+
+    uint64_t mask() const {
+        uint64_t m = background ? background_bit : 0;
+        for (int id : materials)
+            m |= material_bit(id);
+        return m;
+    }
+};
+
+class primary_cache {
+    public:
+        int width = 0;
+        int height = 0;
+        int samples_per_pixel = 0;
+        // samples_per_pixel samples for every pixel, bottom row first
+        std::vector<primary_sample> samples;
+        // Materials (and the sky) that any vertex of any path of a pixel saw
+        std::vector<uint64_t> seen;
+
+    public:
+        void reset(int w, int h, int spp) {
+            width = w;
+            height = h;
+            samples_per_pixel = spp;
+            samples.assign(static_cast<size_t>(w) * h * spp, primary_sample());
+            seen.assign(static_cast<size_t>(w) * h, 0);
+        }
+
+        bool valid() const {return !samples.empty();}
+
+        static size_t memory_needed(int w, int h, int spp) {
+            return static_cast<size_t>(w) * h * (spp * sizeof(primary_sample) + sizeof(uint64_t));
+        }
+
+        primary_sample& at(int i, int j, int s) {
+            return samples[(static_cast<size_t>(j) * width + i) * samples_per_pixel + s];
+        }
+
+        size_t memory_used() const {
+            return samples.size() * sizeof(primary_sample) + seen.size() * sizeof(uint64_t);
+        }
+
+        static void store(primary_sample& sample, const hit_record& rec) {
+            for (int a = 0; a < 3; a++) {
+                sample.p[a] = rec.p[a];
+                sample.normal[a] = static_cast<float>(rec.normal[a]);
+            }
+            sample.material = static_cast<uint32_t>(rec.mat_ptr->id)
+                              | (rec.front_face ? primary_sample::front_face_bit : 0);
+        }
+
+        static void store_miss(primary_sample& sample) {
+            sample.material = primary_sample::no_hit;
+        }
+
+        // Rebuild the hit record of a sample, returns false if the sample hit
+        // nothing. rec.t is left at 0, nothing past the first hit reads it.
+        static bool load(const primary_sample& sample, const std::vector<shared_ptr<material>>& materials,
+                         hit_record& rec) {
+            if (sample.material == primary_sample::no_hit)
+                return false;
+
+            rec.p = point3(sample.p[0], sample.p[1], sample.p[2]);
+            rec.normal = vec3(sample.normal[0], sample.normal[1], sample.normal[2]);
+            rec.front_face = (sample.material & primary_sample::front_face_bit) != 0;
+            rec.mat_ptr = materials[sample.material & ~primary_sample::front_face_bit];
+            rec.t = 0;
+            return true;
+        }
+};
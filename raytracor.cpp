@@ -0,0 +1,476 @@
+// libraytracor, the C interface of raytracor.h over render_session.
+// This is the only translation unit that includes the renderer's headers.
+
+#include <cstring>
+#include <new>
+
+#include "raytracor.h"
+
+#include "rt.h"
+#include "camera.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+#include "plane.h"
+#include "aarect.h"
+#include "box.h"
+#include "disk.h"
+#include "cylinder.h"
+#include "render.h"
+
+// What a material was created with, a new session builds its own copy of
+// every material from these
+struct material_desc {
+    int type;
+    color albedo;
+    double fuzz;
+    double ir;
+};
+
+struct rt_scene {
+    std::vector<material_desc> materials;
+    // Shapes are kept as recipes, so that every numa replica of the scene
+    // can make its own with the materials of that replica
+    std::vector<std::function<shared_ptr<hittable>(const std::vector<shared_ptr<material>>&)>> shapes;
+    rt_camera cam;
+    color sky_horizon = color(1.0, 1.0, 1.0);
+    color sky_zenith = color(0.5, 0.7, 1.0);
+
+    std::atomic<bool> cancel{false};
+
+    // The last render, kept for incremental re-renders
+    std::unique_ptr<render_session> session;
+    film image;
+    render_stats stats;
+    bool incremental = false;
+    rt_render_options options;
+    rt_camera session_camera;
+    // Edits since the last render
+    scene_change change;
+    // Shapes were added since the session was made, it has to be rebuilt
+    bool geometry_changed = true;
+};
+
+static vec3 to_vec3(const rt_vec3& v) {
+    return vec3(v.x, v.y, v.z);
+}
+
+static rt_vec3 to_rt_vec3(const vec3& v) {
+    return rt_vec3{v.x(), v.y(), v.z()};
+}
+
+static shared_ptr<material> make_material(const material_desc& desc) {
+    switch (desc.type) {
+        case RT_METAL:
+            return make_shared<metal>(desc.albedo, desc.fuzz);
+        case RT_DIELECTRIC:
+            return make_shared<dielectric>(desc.ir);
+        default:
+            return make_shared<lambertian>(desc.albedo);
+    }
+}
+
+static bool same_camera(const rt_camera& a, const rt_camera& b) {
+    return memcmp(&a, &b, sizeof(rt_camera)) == 0;
+}
+
+static bool same_options(const rt_render_options& a, const rt_render_options& b) {
+    return a.width == b.width && a.height == b.height
+        && a.samples_per_pixel == b.samples_per_pixel && a.max_depth == b.max_depth
+        && a.t_min == b.t_min && a.threads == b.threads && a.tile_size == b.tile_size
+        && a.numa == b.numa && a.numa_fake_nodes == b.numa_fake_nodes
+        && a.numa_interleave == b.numa_interleave && a.guiding == b.guiding
+        && a.guiding_memory == b.guiding_memory && a.cache_primary == b.cache_primary
+        && a.cache_memory == b.cache_memory && a.seed == b.seed;
+}
+
+// Run `body`, turning whatever it throws into a status, nothing may unwind
+// through the C interface
+template <typename F>
+static int guarded(F body) {
+    try {
+        return body();
+    } catch (const std::bad_alloc&) {
+        return RT_OUT_OF_MEMORY;
+    } catch (...) {
+        return RT_ERROR;
+    }
+}
+
+int rt_api_version(void) {
+    return RT_API_VERSION;
+}
+
+const char* rt_status_string(int status) {
+    switch (status) {
+        case RT_OK: return "ok";
+        case RT_CANCELLED: return "cancelled";
+        case RT_INVALID_ARGUMENT: return "invalid argument";
+        case RT_OUT_OF_MEMORY: return "out of memory";
+        default: return "error";
+    }
+}
+
+rt_scene* rt_scene_create(void) {
+    auto scene = new (std::nothrow) rt_scene;
+    if (!scene)
+        return nullptr;
+
+    // The default camera of the book, at the origin looking down -z
+    scene->cam.lookfrom = rt_vec3{0, 0, 0};
+    scene->cam.lookat = rt_vec3{0, 0, -1};
+    scene->cam.vup = rt_vec3{0, 1, 0};
+    scene->cam.vfov = 90;
+    scene->cam.aperture = 0;
+    scene->cam.focus_dist = 1;
+    return scene;
+}
+
+void rt_scene_destroy(rt_scene* scene) {
+    delete scene;
+}
+
+static int add_material(rt_scene* scene, const material_desc& desc) {
+    if (!scene)
+        return RT_INVALID_ARGUMENT;
+    return guarded([&]() {
+        scene->materials.push_back(desc);
+        scene->geometry_changed = true;
+        return static_cast<int>(scene->materials.size()) - 1;
+    });
+}
+
+int rt_scene_add_lambertian(rt_scene* scene, rt_vec3 albedo) {
+    return add_material(scene, {RT_LAMBERTIAN, to_vec3(albedo), 0, 0});
+}
+
+int rt_scene_add_metal(rt_scene* scene, rt_vec3 albedo, double fuzz) {
+    return add_material(scene, {RT_METAL, to_vec3(albedo), fuzz < 1 ? fuzz : 1, 0});
+}
+
+int rt_scene_add_dielectric(rt_scene* scene, double index_of_refraction) {
+    return add_material(scene, {RT_DIELECTRIC, color(1, 1, 1), 0, index_of_refraction});
+}
+
+int rt_scene_material_count(const rt_scene* scene) {
+    if (!scene)
+        return RT_INVALID_ARGUMENT;
+    return static_cast<int>(scene->materials.size());
+}
+
+int rt_scene_material_info(const rt_scene* scene, int id, rt_material_info* info) {
+    if (!scene || !info || id < 0 || id >= static_cast<int>(scene->materials.size()))
+        return RT_INVALID_ARGUMENT;
+
+    const auto& desc = scene->materials[id];
+    info->type = desc.type;
+    info->albedo = to_rt_vec3(desc.albedo);
+    info->fuzz = desc.fuzz;
+    info->ir = desc.ir;
+    return RT_OK;
+}
+
+template <typename Shape, typename... Args>
+static int add_shape(rt_scene* scene, int id, Args... args) {
+    if (!scene || id < 0 || id >= static_cast<int>(scene->materials.size()))
+        return RT_INVALID_ARGUMENT;
+    return guarded([&]() {
+        scene->shapes.push_back([=](const std::vector<shared_ptr<material>>& materials) {
+            return shared_ptr<hittable>(make_shared<Shape>(args..., materials[id]));
+        });
+        scene->geometry_changed = true;
+        return RT_OK;
+    });
+}
+
+int rt_scene_add_sphere(rt_scene* scene, rt_vec3 center, double radius, int material) {
+    return add_shape<sphere>(scene, material, to_vec3(center), radius);
+}
+
+int rt_scene_add_plane(rt_scene* scene, rt_vec3 point, rt_vec3 normal, int material) {
+    if (to_vec3(normal).near_zero())
+        return RT_INVALID_ARGUMENT;
+    return add_shape<plane>(scene, material, to_vec3(point), to_vec3(normal));
+}
+
+int rt_scene_add_box(rt_scene* scene, rt_vec3 corner0, rt_vec3 corner1, int material) {
+    return add_shape<box>(scene, material, to_vec3(corner0), to_vec3(corner1));
+}
+
+int rt_scene_add_disk(rt_scene* scene, rt_vec3 center, rt_vec3 normal, double radius, int material) {
+    if (to_vec3(normal).near_zero() || radius <= 0)
+        return RT_INVALID_ARGUMENT;
+    return add_shape<disk>(scene, material, to_vec3(center), to_vec3(normal), radius);
+}
+
+int rt_scene_add_cylinder(rt_scene* scene, rt_vec3 base, rt_vec3 axis, double radius,
+                          double height, int material) {
+    if (to_vec3(axis).near_zero() || radius <= 0 || height <= 0)
+        return RT_INVALID_ARGUMENT;
+    return add_shape<cylinder>(scene, material, to_vec3(base), to_vec3(axis), radius, height);
+}
+
+int rt_scene_add_rect(rt_scene* scene, int axis, double a0, double a1,
+                      double b0, double b1, double k, int material) {
+    switch (axis) {
+        case RT_AXIS_X:
+            return add_shape<yz_rect>(scene, material, a0, a1, b0, b1, k);
+        case RT_AXIS_Y:
+            return add_shape<xz_rect>(scene, material, a0, a1, b0, b1, k);
+        case RT_AXIS_Z:
+            return add_shape<xy_rect>(scene, material, a0, a1, b0, b1, k);
+        default:
+            return RT_INVALID_ARGUMENT;
+    }
+}
+
+int rt_scene_set_camera(rt_scene* scene, const rt_camera* camera) {
+    if (!scene || !camera || camera->vfov <= 0 || camera->vfov >= 180)
+        return RT_INVALID_ARGUMENT;
+    scene->cam = *camera;
+    return RT_OK;
+}
+
+int rt_scene_set_sky(rt_scene* scene, rt_vec3 horizon, rt_vec3 zenith) {
+    if (!scene)
+        return RT_INVALID_ARGUMENT;
+    scene->sky_horizon = to_vec3(horizon);
+    scene->sky_zenith = to_vec3(zenith);
+    scene->change.background = true;
+    if (scene->session) {
+        scene->session->settings.sky_horizon = scene->sky_horizon;
+        scene->session->settings.sky_zenith = scene->sky_zenith;
+    }
+    return RT_OK;
+}
+
+static int type_bit(int type) {
+    return 1 << type;
+}
+
+// Edit material `id` of the scene and of the live session, if any, so that
+// the next render can re-render just what the edit touched. `types` are the
+// type_bit()s of the material types the edit makes sense for.
+static int edit_material(rt_scene* scene, int id, int types, const std::function<void(material_desc&)>& edit) {
+    if (!scene || id < 0 || id >= static_cast<int>(scene->materials.size())
+        || !(type_bit(scene->materials[id].type) & types))
+        return RT_INVALID_ARGUMENT;
+
+    return guarded([&]() {
+        auto& desc = scene->materials[id];
+        edit(desc);
+        if (scene->session) {
+            scene->session->edit_material(id, [&](material& m) {
+                if (auto l = dynamic_cast<lambertian*>(&m)) {
+                    l->albedo = desc.albedo;
+                } else if (auto me = dynamic_cast<metal*>(&m)) {
+                    me->albedo = desc.albedo;
+                    me->fuzz = desc.fuzz;
+                } else if (auto d = dynamic_cast<dielectric*>(&m)) {
+                    d->ir = desc.ir;
+                }
+            });
+        }
+        scene->change.materials.push_back(id);
+        return RT_OK;
+    });
+}
+
+int rt_material_set_albedo(rt_scene* scene, int material, rt_vec3 albedo) {
+    return edit_material(scene, material, type_bit(RT_LAMBERTIAN) | type_bit(RT_METAL), [&](material_desc& desc) {
+        desc.albedo = to_vec3(albedo);
+    });
+}
+
+int rt_material_set_fuzz(rt_scene* scene, int material, double fuzz) {
+    return edit_material(scene, material, type_bit(RT_METAL), [&](material_desc& desc) {
+        desc.fuzz = fuzz < 1 ? fuzz : 1;
+    });
+}
+
+int rt_material_set_ir(rt_scene* scene, int material, double index_of_refraction) {
+    return edit_material(scene, material, type_bit(RT_DIELECTRIC), [&](material_desc& desc) {
+        desc.ir = index_of_refraction;
+    });
+}
+
+void rt_render_options_init(rt_render_options* options) {
+    if (!options)
+        return;
+
+    memset(options, 0, sizeof(rt_render_options));
+    options->width = 1920;
+    options->height = 1080;
+    options->samples_per_pixel = 50;
+    options->max_depth = 15;
+    options->t_min = 0.001;
+    options->tile_size = 16;
+    options->guiding_memory = 16 * 1024 * 1024;
+    options->cache_memory = size_t(1024) * 1024 * 1024;
+}
+
+static bool valid_options(const rt_render_options* options) {
+    return options && options->width > 1 && options->height > 1
+        && options->samples_per_pixel > 0 && options->max_depth > 0
+        && options->t_min >= 0 && options->tile_size > 0 && options->threads >= 0
+        && options->numa_fake_nodes >= 0;
+}
+
+static render_settings make_settings(const rt_scene* scene, const rt_render_options& options) {
+    render_settings settings;
+    settings.image_width = options.width;
+    settings.image_height = options.height;
+    settings.samples_per_pixel = options.samples_per_pixel;
+    settings.max_depth = options.max_depth;
+    settings.t_min = options.t_min;
+    settings.tile_size = options.tile_size;
+    settings.threads = options.threads;
+    settings.pin_threads = options.numa || options.numa_fake_nodes > 0;
+    settings.placement = options.numa_interleave ? numa_placement::interleave : numa_placement::replicate;
+    settings.scene_seed = options.seed;
+    settings.guiding = options.guiding;
+    settings.guiding_memory = options.guiding_memory;
+    settings.cache_primary = options.cache_primary;
+    settings.cache_memory = options.cache_memory;
+    settings.sky_horizon = scene->sky_horizon;
+    settings.sky_zenith = scene->sky_zenith;
+    return settings;
+}
+
+static numa_topology make_topology(const rt_render_options& options) {
+    if (options.numa_fake_nodes > 0)
+        return numa_topology::fake_nodes(options.numa_fake_nodes);
+    if (options.numa)
+        return numa_topology::detect();
+    return numa_topology::single_node();
+}
+
+int rt_render(rt_scene* scene, const rt_render_options* options,
+              const rt_framebuffer* framebuffer, rt_tile_callback callback, void* user) {
+    if (!scene || !valid_options(options) || !framebuffer || !framebuffer->data
+        || (framebuffer->channels != 3 && framebuffer->channels != 4))
+        return RT_INVALID_ARGUMENT;
+
+    const int width = options->width;
+    const int height = options->height;
+    const int channels = framebuffer->channels;
+    const size_t packed = static_cast<size_t>(width) * channels * sizeof(float);
+    const size_t stride = framebuffer->row_stride ? framebuffer->row_stride : packed;
+    if (stride < packed || stride % sizeof(float) != 0)
+        return RT_INVALID_ARGUMENT;
+
+    return guarded([&]() {
+        scene->cancel = false;
+
+        // Only material and sky edits since a finished render with the same
+        // options and camera can be re-rendered from the cached first hits.
+        // Anything else that keeps the geometry at least keeps the session.
+        bool same_session = scene->session && !scene->geometry_changed
+                            && same_options(scene->options, *options);
+        bool incremental = same_session && scene->session->cache.valid()
+                           && same_camera(scene->session_camera, scene->cam)
+                           && !scene->stats.cancelled;
+
+        if (!same_session) {
+            scene->session.reset();
+            // Every replica builds its own materials and shapes from the
+            // descriptions, the ids are preset so they match the scene's
+            auto build_scene = [scene]() {
+                std::vector<shared_ptr<material>> materials;
+                for (size_t id = 0; id < scene->materials.size(); id++) {
+                    materials.push_back(make_material(scene->materials[id]));
+                    materials.back()->id = static_cast<int>(id);
+                }
+                hittable_list world;
+                for (const auto& shape : scene->shapes)
+                    world.add(shape(materials));
+                return world;
+            };
+            scene->session = std::make_unique<render_session>(
+                make_settings(scene, *options), make_topology(*options), build_scene);
+            scene->options = *options;
+            scene->geometry_changed = false;
+        }
+
+        auto& session = *scene->session;
+        auto& image = scene->image;
+        session.cancel = &scene->cancel;
+
+        // Resolve a finished tile into the caller's buffer, rows flipped as
+        // the film is bottom row first
+        session.on_tile = [&](const tile& t, int samples) {
+            auto scale = 1.0 / samples;
+            for (int j = t.y0; j < t.y1; ++j) {
+                auto row = reinterpret_cast<float*>(
+                    reinterpret_cast<char*>(framebuffer->data) + (height - 1 - j) * stride);
+                for (int i = t.x0; i < t.x1; ++i) {
+                    const auto& sum = image.pixels[j * width + i];
+                    float* out = row + i * channels;
+                    out[0] = static_cast<float>(sum.x() * scale);
+                    out[1] = static_cast<float>(sum.y() * scale);
+                    out[2] = static_cast<float>(sum.z() * scale);
+                    if (channels == 4)
+                        out[3] = 1;
+                }
+            }
+            if (callback && callback(user, t.x0, height - t.y1, t.x1, height - t.y0))
+                scene->cancel = true;
+        };
+
+        if (incremental) {
+            scene->stats = session.rerender(scene->change, image);
+        } else {
+            auto cam = scene->cam;
+            camera c(to_vec3(cam.lookfrom), to_vec3(cam.lookat), to_vec3(cam.vup), cam.vfov,
+                     double(width) / height, cam.aperture, cam.focus_dist);
+            scene->stats = session.render(c, image);
+            scene->session_camera = cam;
+        }
+        scene->incremental = incremental;
+        scene->change = scene_change();
+
+        session.on_tile = nullptr;
+        session.cancel = nullptr;
+        return scene->stats.cancelled ? RT_CANCELLED : RT_OK;
+    });
+}
+
+void rt_cancel(rt_scene* scene) {
+    if (scene)
+        scene->cancel = true;
+}
+
+int rt_render_stats_get(const rt_scene* scene, rt_render_stats* stats) {
+    if (!scene || !stats || !scene->session)
+        return RT_INVALID_ARGUMENT;
+
+    const auto& s = scene->stats;
+    stats->seconds = s.seconds;
+    stats->passes = s.passes;
+    stats->nodes = static_cast<int>(s.nodes.size());
+    stats->incremental = scene->incremental;
+    stats->pixels = scene->image.pixels.size();
+    stats->pixels_skipped = s.pixels_skipped;
+    stats->guiding_memory = s.guiding_memory;
+    stats->cache_memory = s.cache_memory;
+    stats->cache_over_budget = s.cache_over_budget;
+    stats->mean_variance = scene->image.mean_variance();
+    stats->unpinned = s.unpinned;
+    return RT_OK;
+}
+
+int rt_node_stats_get(const rt_scene* scene, int node, rt_node_stats* stats) {
+    if (!scene || !stats || !scene->session || node < 0
+        || node >= static_cast<int>(scene->stats.nodes.size()))
+        return RT_INVALID_ARGUMENT;
+
+    const auto& s = scene->stats.nodes[node];
+    stats->threads = s.threads;
+    stats->tiles = s.tiles;
+    stats->stolen = s.stolen;
+    stats->samples = s.samples;
+    stats->rays = s.rays;
+    stats->seconds = s.seconds;
+    stats->unpinned = s.unpinned;
+    return RT_OK;
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+// Public interface of libraytracor.
+//
+// Build a scene out of materials and shapes, point a camera at it and render
+// it straight into a float buffer that the caller owns. Re-rendering after
+// only material or sky edits reuses the first hits of the last render.
+//
+// This is the only header an embedding program needs, it is plain C so that
+// anything with a C FFI can use it, with a small C++ wrapper at the bottom.
+// Only functions from this header are exported from libraytracor.so.
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#define RT_API __declspec(dllexport)
+#else
+#define RT_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bumped whenever a struct or function below changes in an incompatible way.
+// It is also the soname of the library, libraytracor.so.RT_API_VERSION, so
+// the dynamic loader refuses a library of another version. A program that
+// loads the library some other way (dlopen, an FFI) should check
+// rt_api_version() == RT_API_VERSION before using anything else.
+#define RT_API_VERSION 3
+
+enum rt_status {
+    RT_OK = 0,
+    // The render was stopped by rt_cancel or by a tile callback
+    RT_CANCELLED = 1,
+    RT_INVALID_ARGUMENT = -1,
+    RT_OUT_OF_MEMORY = -2,
+    RT_ERROR = -3
+};
+
+enum rt_material_type {
+    RT_LAMBERTIAN = 0,
+    RT_METAL = 1,
+    RT_DIELECTRIC = 2
+};
+
+// Axis a rectangle faces, rt_scene_add_rect
+enum rt_axis {
+    RT_AXIS_X = 0,
+    RT_AXIS_Y = 1,
+    RT_AXIS_Z = 2
+};
+
+typedef struct rt_vec3 {
+    double x, y, z;
+} rt_vec3;
+
+typedef struct rt_camera {
+    rt_vec3 lookfrom;
+    rt_vec3 lookat;
+    rt_vec3 vup;
+    // Vertical field of view in degrees
+    double vfov;
+    double aperture;
+    double focus_dist;
+} rt_camera;
+
+typedef struct rt_material_info {
+    int type;
+    rt_vec3 albedo;
+    double fuzz;
+    double ir;
+} rt_material_info;
+
+typedef struct rt_render_options {
+    int width;
+    int height;
+    int samples_per_pixel;
+    int max_depth;
+    // Closest hit accepted along a ray
+    double t_min;
+    // Worker threads, 0 for one per cpu
+    int threads;
+    int tile_size;
+    // Non-zero to pin workers per numa node, numa_fake_nodes > 0 to pretend
+    // there are that many nodes, numa_interleave to interleave the scene
+    // instead of replicating it per node
+    int numa;
+    int numa_fake_nodes;
+    int numa_interleave;
+    // Path guiding and its memory budget in bytes
+    int guiding;
+    size_t guiding_memory;
+    // Keep the first hits, so that later renders after material or sky
+    // edits only redo what the edits touched. 40 bytes a sample, a render
+    // that would need more than cache_memory bytes is not cached.
+    int cache_primary;
+    size_t cache_memory;
+    // The same scene, options and seed render the same image, except with
+    // guiding on more than one thread
+    unsigned int seed;
+} rt_render_options;
+
+// Where rt_render writes, owned by the caller. Pixels are the linear average
+// of their samples, no gamma, top row first.
+typedef struct rt_framebuffer {
+    float* data;
+    // 3 for rgb, 4 for rgba with alpha left at 1
+    int channels;
+    // Bytes from the start of one row to the next, 0 for tightly packed
+    size_t row_stride;
+} rt_framebuffer;
+
+typedef struct rt_node_stats {
+    int threads;
+    int tiles;
+    // Tiles taken off other nodes' queues
+    int stolen;
+    unsigned long long samples;
+    unsigned long long rays;
+    double seconds;
+    // Workers that could not be pinned to the node's cpus
+    int unpinned;
+} rt_node_stats;
+
+typedef struct rt_render_stats {
+    double seconds;
+    int passes;
+    int nodes;
+    // Non-zero if the render only redid what changed since the last one
+    int incremental;
+    size_t pixels;
+    size_t pixels_skipped;
+    size_t guiding_memory;
+    size_t cache_memory;
+    // Bytes the first hits would have needed, when that was over
+    // rt_render_options::cache_memory and they were not cached
+    size_t cache_over_budget;
+    // Estimated variance of the pixels, see film::mean_variance
+    double mean_variance;
+    // Threads that rt_render_options::numa could not pin to their node's cpus
+    int unpinned;
+} rt_render_stats;
+
+// Called from the render threads after every finished tile, with the tile's
+// pixel range [x0, x1) x [y0, y1) in framebuffer rows, top row first. Those
+// pixels of the framebuffer are up to date by then. Several threads can be in
+// it at once. With guiding every pass calls it once per tile.
+// Return non-zero to cancel the render.
+typedef int (*rt_tile_callback)(void* user, int x0, int y0, int x1, int y1);
+
+typedef struct rt_scene rt_scene;
+
+// RT_API_VERSION of the library that is loaded
+RT_API int rt_api_version(void);
+RT_API const char* rt_status_string(int status);
+
+RT_API rt_scene* rt_scene_create(void);
+RT_API void rt_scene_destroy(rt_scene* scene);
+
+// Materials return their id (>= 0), or a negative rt_status
+RT_API int rt_scene_add_lambertian(rt_scene* scene, rt_vec3 albedo);
+RT_API int rt_scene_add_metal(rt_scene* scene, rt_vec3 albedo, double fuzz);
+RT_API int rt_scene_add_dielectric(rt_scene* scene, double index_of_refraction);
+RT_API int rt_scene_material_count(const rt_scene* scene);
+RT_API int rt_scene_material_info(const rt_scene* scene, int material, rt_material_info* info);
+
+// Shapes
+RT_API int rt_scene_add_sphere(rt_scene* scene, rt_vec3 center, double radius, int material);
+RT_API int rt_scene_add_plane(rt_scene* scene, rt_vec3 point, rt_vec3 normal, int material);
+RT_API int rt_scene_add_box(rt_scene* scene, rt_vec3 corner0, rt_vec3 corner1, int material);
+RT_API int rt_scene_add_disk(rt_scene* scene, rt_vec3 center, rt_vec3 normal, double radius,
+                             int material);
+RT_API int rt_scene_add_cylinder(rt_scene* scene, rt_vec3 base, rt_vec3 axis, double radius,
+                                 double height, int material);
+// Rectangle facing `axis` at axis coordinate k, spanning [a0, a1] x [b0, b1]
+// over the other two axes in x, y, z order
+RT_API int rt_scene_add_rect(rt_scene* scene, int axis, double a0, double a1,
+                             double b0, double b1, double k, int material);
+
+RT_API int rt_scene_set_camera(rt_scene* scene, const rt_camera* camera);
+RT_API int rt_scene_set_sky(rt_scene* scene, rt_vec3 horizon, rt_vec3 zenith);
+
+// Material edits, cheap to re-render when cache_primary is on
+RT_API int rt_material_set_albedo(rt_scene* scene, int material, rt_vec3 albedo);
+RT_API int rt_material_set_fuzz(rt_scene* scene, int material, double fuzz);
+RT_API int rt_material_set_ir(rt_scene* scene, int material, double index_of_refraction);
+
+RT_API void rt_render_options_init(rt_render_options* options);
+
+// Render into `framebuffer`, blocking until done or cancelled. `callback` may be null.
+RT_API int rt_render(rt_scene* scene, const rt_render_options* options,
+                     const rt_framebuffer* framebuffer, rt_tile_callback callback, void* user);
+// Stop the running render of `scene`, safe to call from any thread
+RT_API void rt_cancel(rt_scene* scene);
+
+RT_API int rt_render_stats_get(const rt_scene* scene, rt_render_stats* stats);
+RT_API int rt_node_stats_get(const rt_scene* scene, int node, rt_node_stats* stats);
+
+#ifdef __cplusplus
+}
+
+#include <stdexcept>
+#include <string>
+
+namespace raytracor {
+
+// Thrown for any status other than RT_OK and RT_CANCELLED
+class error : public std::runtime_error {
+    public:
+        int status;
+
+    public:
+        error(int s) : std::runtime_error(rt_status_string(s)), status(s) {}
+};
+
+inline int check(int status) {
+    if (status < 0)
+        throw error(status);
+    return status;
+}
+
+// Owns an rt_scene
+class scene {
+    public:
+        rt_scene* handle;
+
+    public:
+        scene() : handle(rt_scene_create()) {
+            if (!handle)
+                throw error(RT_OUT_OF_MEMORY);
+        }
+        ~scene() {rt_scene_destroy(handle);}
+        scene(const scene&) = delete;
+        scene& operator=(const scene&) = delete;
+
+        int lambertian(rt_vec3 albedo) {return check(rt_scene_add_lambertian(handle, albedo));}
+        int metal(rt_vec3 albedo, double fuzz) {return check(rt_scene_add_metal(handle, albedo, fuzz));}
+        int dielectric(double ir) {return check(rt_scene_add_dielectric(handle, ir));}
+
+        void sphere(rt_vec3 center, double radius, int m) {
+            check(rt_scene_add_sphere(handle, center, radius, m));
+        }
+        void plane(rt_vec3 point, rt_vec3 normal, int m) {
+            check(rt_scene_add_plane(handle, point, normal, m));
+        }
+        void box(rt_vec3 corner0, rt_vec3 corner1, int m) {
+            check(rt_scene_add_box(handle, corner0, corner1, m));
+        }
+        void disk(rt_vec3 center, rt_vec3 normal, double radius, int m) {
+            check(rt_scene_add_disk(handle, center, normal, radius, m));
+        }
+        void cylinder(rt_vec3 base, rt_vec3 axis, double radius, double height, int m) {
+            check(rt_scene_add_cylinder(handle, base, axis, radius, height, m));
+        }
+        void rect(int axis, double a0, double a1, double b0, double b1, double k, int m) {
+            check(rt_scene_add_rect(handle, axis, a0, a1, b0, b1, k, m));
+        }
+
+        void camera(const rt_camera& c) {check(rt_scene_set_camera(handle, &c));}
+        void sky(rt_vec3 horizon, rt_vec3 zenith) {check(rt_scene_set_sky(handle, horizon, zenith));}
+
+        // Returns RT_OK, or RT_CANCELLED
+        int render(const rt_render_options& options, const rt_framebuffer& framebuffer,
+                   rt_tile_callback callback = nullptr, void* user = nullptr) {
+            return check(rt_render(handle, &options, &framebuffer, callback, user));
+        }
+        void cancel() {rt_cancel(handle);}
+};
+
+} // namespace raytracor
+#endif
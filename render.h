@@ -0,0 +1,646 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rt.h"
+#include "camera.h"
+#include "color.h"
+#include "bvh.h"
+#include "guiding.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "numa.h"
+#include "primary_cache.h"
+
+struct render_settings {
+    int image_width;
+    int image_height;
+    int samples_per_pixel;
+    // So that it ray_color doesn't try to bounce limitlessly and segfault
+    int max_depth;
+    // Closest hit accepted along a ray, hides self-intersection (shadow acne)
+    double t_min = 0.001;
+    // Width and height of the square tiles handed out to the workers
+    int tile_size = 16;
+    // Number of worker threads, 0 runs one worker per cpu in the topology
+    int threads = 0;
+    // Pin every worker to the cpus of its node
+    bool pin_threads = false;
+    numa_placement placement = numa_placement::replicate;
+    // Seed the scene is built with, every replica has to come out identical
+    unsigned int scene_seed = 0;
+    // Learn the incoming light while rendering and guide diffuse bounces with it.
+    // The samples are then rendered in passes of 1, 2, 4, ... samples per pixel
+    // and the guiding is refined between passes.
+    // Everything the guiding learns has to fit into guiding_memory bytes.
+    bool guiding = false;
+    size_t guiding_memory = 16 * 1024 * 1024;
+    // Keep the first hit of every sample, so that render_session::rerender can
+    // skip the first hit tests after a material or sky edit. 40 bytes a sample,
+    // a render that would need more than cache_memory bytes is not cached.
+    bool cache_primary = false;
+    size_t cache_memory = size_t(1024) * 1024 * 1024;
+    // The sky, blended from the horizon up to the zenith
+    color sky_horizon = color(1.0, 1.0, 1.0);
+    color sky_zenith = color(0.5, 0.7, 1.0);
+};
+
+// Accumulated samples of a render, laid out bottom row first like get_ray
+struct film {
+    int width = 0;
+    int height = 0;
+    int samples = 0;
+    // Sum of every sample of a pixel
+    std::vector<color> pixels;
+    // Sum of the squared luminance of every sample of a pixel
+    std::vector<double> squares;
+
+    void reset(int w, int h) {
+        width = w;
+        height = h;
+        samples = 0;
+        pixels.assign(w * h, color(0, 0, 0));
+        squares.assign(w * h, 0);
+    }
+
+    // Variance of the pixel estimates averaged over the image, an estimate of
+    // the mean squared error of the render that needs no reference image
+    double mean_variance() const {
+        if (samples < 2)
+            return 0;
+        double total = 0;
+        for (size_t k = 0; k < pixels.size(); k++) {
+            auto mean = luminance(pixels[k]) / samples;
+            auto sample_variance = (squares[k] / samples - mean * mean) * samples / (samples - 1);
+            total += sample_variance / samples;
+        }
+        return total / pixels.size();
+    }
+};
+
+// Pixels [x0, x1) x [y0, y1) of the image, y grows upwards like in get_ray
+struct tile {
+    int x0, y0;
+    int x1, y1;
+};
+
+// Work and throughput of one numa node over a render
+struct node_stats {
+    int threads = 0;
+    int tiles = 0;
+    // Tiles that this node took off another node's queue
+    int stolen = 0;
+    unsigned long long samples = 0;
+    unsigned long long rays = 0;
+    // Time the node's workers were running, summed over the passes
+    double seconds = 0;
+    // Workers that could not be pinned to the node's cpus
+    int unpinned = 0;
+};
+
+struct render_stats {
+    std::vector<node_stats> nodes;
+    double seconds = 0;
+    int passes = 0;
+    bool cancelled = false;
+    // Threads that could not be pinned to their node's cpus, the workers and
+    // the threads that built the scene replicas. Their memory may have ended
+    // up on another node.
+    int unpinned = 0;
+    // Pixels a re-render left alone, their paths never saw what changed
+    size_t pixels_skipped = 0;
+    size_t cache_memory = 0;
+    // What the primary cache would have needed when that was over
+    // render_settings::cache_memory and the render was not cached
+    size_t cache_over_budget = 0;
+    // Memory held by the path guiding structure at the end of the render
+    size_t guiding_memory = 0;
+};
+
+// Tiles that a node's workers go through before they start stealing.
+// Handing out a tile is a single fetch_add, so thieves share the same
+// counter as the owners and no tile can be rendered twice.
+struct tile_queue {
+    std::vector<tile> tiles;
+    std::atomic<size_t> next{0};
+
+    bool pop(tile& t) {
+        auto i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= tiles.size())
+            return false;
+        t = tiles[i];
+        return true;
+    }
+};
+
+
+// What ray_color needs besides the ray, one per worker
+struct trace_context {
+    const hittable& world;
+    const render_settings& settings;
+    guiding_tree* guide;
+    // Numa node of the worker
+    int node = 0;
+    unsigned long long rays = 0;
+    // Materials and the sky seen by the paths traced since it was last cleared
+    uint64_t seen = 0;
+
+    trace_context(const hittable& w, const render_settings& s, guiding_tree* g)
+        : world(w), settings(s), guide(g) {}
+};
+
+color ray_color(const ray& r, trace_context& ctx, int depth);
+
+color background_color(const ray& r, trace_context& ctx) {
+    ctx.seen |= background_bit;
+
+    // Get unit vector of the ray
+    vec3 unit_direction = unit_vector(r.direction());
+    // unit_direction.y() as this is a gradient based on the y-axis
+    auto t = 0.5 * (unit_direction.y() + 1.0);
+
+    // When t = 1.0 - Get blue value
+    // When t = 0.0 - Get white value
+    // Linearly interpolate between the values through the height
+    // If the value is between 0.0 and 1.0, then this will 'mix' the colors
+    return (1.0 - t) * ctx.settings.sky_horizon  // if 1.0, this negates the 'white' vlaue
+            + t * ctx.settings.sky_zenith;       // this is the blue value
+}
+
+// Light leaving a hit back along r, split out of ray_color so that a
+// re-render can start here from a cached first hit
+color hit_color(const ray& r, const hit_record& rec, trace_context& ctx, int depth) {
+    ray scattered;
+    color attenuation;
+
+    ctx.seen |= material_bit(rec.mat_ptr->id);
+
+    // Note : These are abstracted into materials
+    // Uniform scatter direction???
+    // point3 target = rec.p + random_in_hemisphere(rec.normal);
+    // Lambertian diffuse
+    // https://en.wikipedia.org/wiki/Lambertian_reflectance
+    // point3 target = rec.p + rec.normal + random_unit_vector();
+    // return 0.5 * ray_color(ray(rec.p, target - rec.p), world, depth - 1);
+
+    if (ctx.guide && rec.mat_ptr->is_diffuse()) {
+        auto& leaf = ctx.guide->leaf(rec.p);
+        auto bsdf_fraction = ctx.guide->bsdf_fraction;
+
+        // One-sample MIS, pick either the material or the learned
+        // distribution and weigh by the pdf of picking from both
+        bool from_material = random_double() < bsdf_fraction;
+        if (!rec.mat_ptr->scatter(r, rec, attenuation, scattered))
+            return color(0, 0, 0);
+        if (!from_material)
+            scattered = ray(rec.p, leaf.sampling.sample());
+
+        // The material's direction is normal + random_unit_vector(), up to 2
+        // long, the guiding reads a unit direction's z as cos theta
+        auto direction = unit_vector(scattered.direction());
+        auto material_pdf = rec.mat_ptr->scattering_pdf(rec, direction);
+        auto pdf = bsdf_fraction * material_pdf
+                   + (1 - bsdf_fraction) * leaf.sampling.pdf(direction);
+        // Below the surface
+        if (material_pdf <= 0 || pdf <= 0)
+            return color(0, 0, 0);
+
+        color incoming = ray_color(scattered, ctx, depth - 1);
+        leaf.building.record(direction, luminance(incoming) / pdf);
+        return attenuation * material_pdf * incoming / pdf;
+    }
+
+    if (rec.mat_ptr->scatter(r, rec, attenuation, scattered)) {
+        return attenuation * ray_color(scattered, ctx, depth - 1);
+    }
+
+    return color(0, 0, 0);
+}
+
+color ray_color(const ray& r, trace_context& ctx, int depth) {
+    // Create a temporary hit_record
+    hit_record rec;
+
+    // If exceeded ray bounce limit, don't generate anymore light
+    if (depth <= 0) {
+        return color(0, 0, 0);
+    }
+
+    ctx.rays++;
+
+    // If the world hits anything at the current ray, rec will be modified
+    // with the appropriate values
+    // t_min is 0.001 rather than 0 as t can be ~0.000000001 - shadow acne
+    // https://digitalrune.github.io/DigitalRune-Documentation/html/3f4d959e-9c98-4a97-8d85-7a73c26145d7.htm
+    if (ctx.world.hit(r, ctx.settings.t_min, infinity, rec)) {
+        return hit_color(r, rec, ctx, depth);
+    }
+
+    return background_color(r, ctx);
+}
+
+// Number the materials of a scene in the order its objects were added, so
+// that the replicas, built the same way, come out with the same numbers.
+// A scene can also number all of its materials itself beforehand.
+void number_materials(const hittable_list& scene, std::vector<shared_ptr<material>>& table) {
+    std::vector<shared_ptr<material>> used;
+    scene.collect_materials(used);
+
+    for (const auto& m : used) {
+        if (m->id < 0)
+            m->id = static_cast<int>(table.size());
+        if (m->id >= static_cast<int>(table.size()))
+            table.resize(m->id + 1);
+        table[m->id] = m;
+    }
+}
+
+// Renders a scene, possibly more than once. Owns the scene (one replica per
+// numa node when replicating), the path guiding and the primary hit cache,
+// so that a material or sky edit can be re-rendered without starting over.
+class render_session {
+    public:
+        render_settings settings;
+        numa_topology topology;
+        std::vector<hittable_list> worlds;
+        // materials[n][id] is material `id` of worlds[n]
+        std::vector<std::vector<shared_ptr<material>>> materials;
+        std::unique_ptr<guiding_tree> guide;
+        primary_cache cache;
+
+        // Called from the worker threads whenever a tile is done, along with
+        // the number of samples its pixels hold by then
+        std::function<void(const tile&, int)> on_tile;
+        // Once this is set, workers stop picking up tiles and the render returns
+        // early with stats.cancelled set, the film is left partly rendered
+        const std::atomic<bool>* cancel = nullptr;
+
+    public:
+        render_session(const render_settings& s, const numa_topology& t,
+                       const std::function<hittable_list()>& build_scene);
+
+        // Render from scratch, which also fills the primary hit cache
+        render_stats render(const camera& cam, film& image);
+
+        // Render again after the edits in `change`, starting every sample at its
+        // cached first hit and only for pixels whose paths saw something that
+        // changed. Needs a previous render() with settings.cache_primary.
+        // A pixel that missed the edit in every one of its samples keeps its
+        // old value. The samples are drawn with the same random numbers as
+        // in render(), so that is exactly what rendering it again would give.
+        render_stats rerender(const scene_change& change, film& image);
+
+        // Apply `edit` to material `id` in every replica of the scene
+        void edit_material(int id, const std::function<void(material&)>& edit) {
+            for (auto& list : materials) {
+                if (id < static_cast<int>(list.size()) && list[id])
+                    edit(*list[id]);
+            }
+        }
+
+        const hittable_list& world_for(int node) const {
+            return settings.placement == numa_placement::replicate ? worlds[node] : worlds[0];
+        }
+
+        const std::vector<shared_ptr<material>>& materials_for(int node) const {
+            return settings.placement == numa_placement::replicate ? materials[node] : materials[0];
+        }
+
+    private:
+        std::vector<tile> tiles;
+        int threads = 0;
+        // Workers of each node, in proportion to its cpus
+        std::vector<int> node_threads;
+        // Scene builders that could not be pinned to their node
+        int unpinned_builders = 0;
+        // Camera of the last render(), a re-render makes its camera rays again
+        std::unique_ptr<camera> last_camera;
+
+        // Seed the random numbers of sample s of pixel (i, j) from the scene
+        // seed. The same seed then renders the same image no matter which
+        // worker gets which tile, and a re-render draws the same numbers for
+        // a sample as the render did. Only with guiding, where the workers
+        // learn from each other while rendering, do more than one worker
+        // make it vary.
+        void seed_sample(int i, int j, int s) const {
+            auto sample = (static_cast<uint64_t>(j) * settings.image_width + i) * settings.samples_per_pixel + s;
+            seed_random(settings.scene_seed + 1 + sample);
+        }
+
+        // Hand the tiles out to the workers, run_tile does the actual work and
+        // leaves `samples` samples in every pixel of the tile
+        void run_pass(render_stats& stats, int samples,
+                      const std::function<void(const tile&, trace_context&, node_stats&)>& run_tile);
+
+        bool cancelled() const {return cancel && cancel->load(std::memory_order_relaxed);}
+};
+
+render_session::render_session(const render_settings& s, const numa_topology& t,
+                               const std::function<hittable_list()>& build_scene)
+    : settings(s), topology(t) {
+    const int nodes = topology.node_count();
+
+    // Scene placement, the materials are numbered before the bvh reorders
+    // the objects
+    worlds.resize(nodes);
+    if (settings.placement == numa_placement::replicate && nodes > 1) {
+        materials.resize(nodes);
+        std::atomic<int> unpinned{0};
+        std::vector<std::thread> builders;
+        for (int n = 0; n < nodes; n++) {
+            builders.emplace_back([&, n]() {
+                // First-touch only puts the replica on node n from one of its cpus
+                if (settings.pin_threads && !pin_thread_to_cpus(topology.cpus[n]))
+                    unpinned++;
+                seed_random(settings.scene_seed);
+                auto scene = build_scene();
+                number_materials(scene, materials[n]);
+                worlds[n] = build_bvh_world(scene);
+            });
+        }
+        for (auto& builder : builders)
+            builder.join();
+        unpinned_builders = unpinned;
+    } else {
+        materials.resize(1);
+        bool interleaved = settings.placement == numa_placement::interleave
+                           && interleave_thread_memory(topology, true);
+        seed_random(settings.scene_seed);
+        auto scene = build_scene();
+        number_materials(scene, materials[0]);
+        worlds[0] = build_bvh_world(scene);
+        if (interleaved)
+            interleave_thread_memory(topology, false);
+    }
+
+    // Split the image into tiles
+    for (int y = 0; y < settings.image_height; y += settings.tile_size) {
+        for (int x = 0; x < settings.image_width; x += settings.tile_size) {
+            tiles.push_back({x, y,
+                             std::min(x + settings.tile_size, settings.image_width),
+                             std::min(y + settings.tile_size, settings.image_height)});
+        }
+    }
+
+    // Spread the workers over the nodes
+    threads = settings.threads;
+    if (threads <= 0) {
+        threads = 0;
+        for (const auto& cpus : topology.cpus)
+            threads += static_cast<int>(cpus.size());
+    }
+    node_threads = topology.workers_per_node(threads);
+}
+
+// Each node gets a contiguous band of tiles as wide as its share of the
+// workers, its workers drain their own queue first and only then steal from
+// the other nodes, the nearest by numa distance first.
+void render_session::run_pass(render_stats& stats, int samples,
+        const std::function<void(const tile&, trace_context&, node_stats&)>& run_tile) {
+    using clock = std::chrono::steady_clock;
+
+    const int nodes = topology.node_count();
+    if (stats.nodes.empty()) {
+        stats.nodes.resize(nodes);
+        for (int n = 0; n < nodes; n++)
+            stats.nodes[n].threads = node_threads[n];
+    }
+
+    std::vector<tile_queue> queues(nodes);
+    for (size_t k = 0, n = 0, band_end = node_threads[0]; k < tiles.size(); k++) {
+        // Tile k sits at k * threads / tiles of the way through the workers
+        while (k * threads >= band_end * tiles.size())
+            band_end += node_threads[++n];
+        queues[n].tiles.push_back(tiles[k]);
+    }
+
+    std::vector<clock::time_point> node_start(nodes, clock::time_point::max());
+    std::vector<clock::time_point> node_end(nodes, clock::time_point::min());
+    std::mutex mutex;
+
+    auto worker = [&](int node) {
+        node_stats local;
+        if (settings.pin_threads && !pin_thread_to_cpus(topology.cpus[node]))
+            local.unpinned++;
+
+        trace_context ctx(world_for(node), settings, guide.get());
+        ctx.node = node;
+        auto start = clock::now();
+
+        auto victims = topology.steal_order(node);
+        victims.insert(victims.begin(), node);
+
+        tile t;
+        for (int victim : victims) {
+            while (!cancelled() && queues[victim].pop(t)) {
+                run_tile(t, ctx, local);
+                if (on_tile)
+                    on_tile(t, samples);
+                local.tiles++;
+                if (victim != node)
+                    local.stolen++;
+            }
+        }
+
+        auto end = clock::now();
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& s = stats.nodes[node];
+        s.tiles += local.tiles;
+        s.stolen += local.stolen;
+        s.samples += local.samples;
+        s.rays += ctx.rays;
+        // The same workers are pinned again every pass, count them once
+        if (stats.passes == 0)
+            s.unpinned += local.unpinned;
+        node_start[node] = std::min(node_start[node], start);
+        node_end[node] = std::max(node_end[node], end);
+    };
+
+    std::vector<std::thread> workers;
+    for (int n = 0; n < nodes; n++) {
+        for (int k = 0; k < node_threads[n]; k++)
+            workers.emplace_back(worker, n);
+    }
+    for (auto& w : workers)
+        w.join();
+
+    for (int n = 0; n < nodes; n++) {
+        if (stats.nodes[n].threads > 0)
+            stats.nodes[n].seconds += std::chrono::duration<double>(node_end[n] - node_start[n]).count();
+    }
+
+    stats.unpinned = unpinned_builders;
+    for (const auto& n : stats.nodes)
+        stats.unpinned += n.unpinned;
+    stats.passes++;
+    stats.cancelled = cancelled();
+}
+
+render_stats render_session::render(const camera& cam, film& image) {
+    using clock = std::chrono::steady_clock;
+    const auto render_start = clock::now();
+
+    last_camera = std::make_unique<camera>(cam);
+    image.reset(settings.image_width, settings.image_height);
+
+    render_stats stats;
+
+    cache = primary_cache();
+    if (settings.cache_primary) {
+        auto needed = primary_cache::memory_needed(settings.image_width, settings.image_height,
+                                                   settings.samples_per_pixel);
+        if (needed <= settings.cache_memory)
+            cache.reset(settings.image_width, settings.image_height, settings.samples_per_pixel);
+        else
+            stats.cache_over_budget = needed;
+    }
+
+    // The guiding is shared by every node, it learns from all of the samples.
+    // Its bounds are those of the bounded objects and the camera, anything
+    // outside of them (the ground plane) falls into the nearest region.
+    guide.reset();
+    if (settings.guiding) {
+        aabb bounds(cam.origin, cam.origin);
+        aabb box;
+        for (const auto& object : worlds[0].objects) {
+            if (object->bounding_box(box))
+                bounds = surrounding_box(bounds, box);
+        }
+        guide = std::make_unique<guiding_tree>(bounds, settings.guiding_memory);
+    }
+
+    // Add `samples` samples to every pixel of a tile
+    auto render_pass = [&](int samples) {
+        int first_sample = image.samples;
+        run_pass(stats, first_sample + samples, [&](const tile& t, trace_context& ctx, node_stats& local) {
+            for (int j = t.y0; j < t.y1; ++j) {
+                for (int i = t.x0; i < t.x1; ++i) {
+                    color pixel_color(0, 0, 0);
+                    double pixel_squares = 0;
+                    ctx.seen = 0;
+                    // Anti alias around the pixel
+                    // Using random is to "move" the pixel around a 0-1 area
+                    // Given enough times (samples_per_pixel), this will normalize out
+                    // and 'antialias' on the pixel.
+                    for (int s = 0; s < samples; ++s) {
+                        seed_sample(i, j, first_sample + s);
+                        // Convert to relative scales
+                        auto u = (i + random_double()) / (settings.image_width - 1);
+                        auto v = (j + random_double()) / (settings.image_height - 1);
+                        // Get a ray from the camera
+                        ray r = cam.get_ray(u, v);
+                        // Get the colour
+                        // Pass in max_depth first, as it will decrement as it recursively goes down
+                        color sample;
+                        if (cache.valid()) {
+                            // Same as ray_color, with the first hit kept
+                            hit_record rec;
+                            ctx.rays++;
+                            auto& cached = cache.at(i, j, first_sample + s);
+                            if (ctx.world.hit(r, settings.t_min, infinity, rec)) {
+                                primary_cache::store(cached, rec);
+                                sample = hit_color(r, rec, ctx, settings.max_depth);
+                            } else {
+                                primary_cache::store_miss(cached);
+                                sample = background_color(r, ctx);
+                            }
+                        } else {
+                            sample = ray_color(r, ctx, settings.max_depth);
+                        }
+                        pixel_color += sample;
+                        pixel_squares += luminance(sample) * luminance(sample);
+                    }
+                    image.pixels[j * settings.image_width + i] += pixel_color;
+                    image.squares[j * settings.image_width + i] += pixel_squares;
+                    if (cache.valid())
+                        cache.seen[j * settings.image_width + i] |= ctx.seen;
+                }
+            }
+            local.samples += static_cast<unsigned long long>(t.x1 - t.x0) * (t.y1 - t.y0) * samples;
+        });
+        image.samples += samples;
+    };
+
+    if (guide) {
+        // Passes of 1, 2, 4, ... samples, the guiding learns from each pass and
+        // the next pass, which has as many samples as all before it, uses it.
+        // The last pass takes every sample that is left, rather than leaving a
+        // remainder too small to be worth another pass.
+        for (int samples = 1; image.samples < settings.samples_per_pixel && !stats.cancelled; samples *= 2) {
+            auto left = settings.samples_per_pixel - image.samples;
+            render_pass(2 * samples > left - samples ? left : samples);
+            if (image.samples < settings.samples_per_pixel && !stats.cancelled)
+                guide->refine();
+        }
+        stats.guiding_memory = guide->memory_used();
+    } else {
+        render_pass(settings.samples_per_pixel);
+    }
+
+    stats.cache_memory = cache.memory_used();
+    stats.seconds = std::chrono::duration<double>(clock::now() - render_start).count();
+    return stats;
+}
+
+render_stats render_session::rerender(const scene_change& change, film& image) {
+    using clock = std::chrono::steady_clock;
+    const auto render_start = clock::now();
+
+    render_stats stats;
+    if (!cache.valid())
+        return stats;
+
+    const auto changed = change.mask();
+    std::atomic<size_t> skipped{0};
+
+    run_pass(stats, image.samples, [&](const tile& t, trace_context& ctx, node_stats& local) {
+        const auto& node_materials = materials_for(ctx.node);
+
+        size_t tile_skipped = 0;
+        for (int j = t.y0; j < t.y1; ++j) {
+            for (int i = t.x0; i < t.x1; ++i) {
+                auto pixel = j * settings.image_width + i;
+                if (!(cache.seen[pixel] & changed)) {
+                    tile_skipped++;
+                    continue;
+                }
+
+                color pixel_color(0, 0, 0);
+                double pixel_squares = 0;
+                ctx.seen = 0;
+                for (int s = 0; s < cache.samples_per_pixel; ++s) {
+                    // The random numbers render() drew for the sample, every
+                    // path that stays clear of the edit comes out as it did
+                    // before, just like in the pixels that are skipped
+                    seed_sample(i, j, s);
+                    auto u = (i + random_double()) / (settings.image_width - 1);
+                    auto v = (j + random_double()) / (settings.image_height - 1);
+                    ray r = last_camera->get_ray(u, v);
+                    hit_record rec;
+                    color sample;
+                    if (primary_cache::load(cache.at(i, j, s), node_materials, rec))
+                        sample = hit_color(r, rec, ctx, settings.max_depth);
+                    else
+                        sample = background_color(r, ctx);
+                    pixel_color += sample;
+                    pixel_squares += luminance(sample) * luminance(sample);
+                }
+                image.pixels[pixel] = pixel_color;
+                image.squares[pixel] = pixel_squares;
+                cache.seen[pixel] = ctx.seen;
+                local.samples += cache.samples_per_pixel;
+            }
+        }
+        skipped += tile_skipped;
+    });
+
+    stats.pixels_skipped = skipped;
+    stats.cache_memory = cache.memory_used();
+    stats.seconds = std::chrono::duration<double>(clock::now() - render_start).count();
+    return stats;
+}
@@ -1,10 +1,10 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <memory>
 #include <cstdlib>
-#include <random>
 
 // Usings
 using std::shared_ptr;
@@ -20,12 +20,33 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+// Every thread owns its own generator, rand() takes a global lock in glibc
+// which serialises the render workers on every sample.
+// The generator is splitmix64, a single word of state, so that the render
+// can reseed it for every sample, std::mt19937 takes microseconds to seed.
+inline uint64_t& random_generator() {
+    static thread_local uint64_t state = 0;
+    return state;
+}
+
+inline uint64_t random_bits() {
+    auto z = (random_generator() += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+inline void seed_random(uint64_t seed) {
+    // Start from a scrambled seed, so that neighbouring seeds, such as those
+    // of neighbouring samples, start far apart
+    random_generator() = seed;
+    random_generator() = random_bits();
+}
+
 inline double random_double() {
-    // Returns a random real in [0, 1];
-    return rand() / (RAND_MAX + 1.0);
-    // static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    // static std::mt19937 generator;
-    // return distribution(generator);
+    // Returns a random real in [0, 1);
+    // the top 53 bits, as many as a double holds
+    return (random_bits() >> 11) * (1.0 / 9007199254740992.0);
 }
 
 inline double random_double(double min, double max) {
@@ -17,6 +17,10 @@ class sphere : public hittable {
 
         virtual bool hit(
                 const ray& ray, double t_min, double t_max, hit_record& rec) const override;
+        virtual bool bounding_box(aabb& output_box) const override;
+        virtual void collect_materials(std::vector<shared_ptr<material>>& out) const override {
+            out.push_back(mat_ptr);
+        }
 };
 
 bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
@@ -53,3 +57,10 @@ bool sphere::hit(const ray& r, double t_min, double t_max, hit_record& rec) cons
 
     return true;
 }
+
+bool sphere::bounding_box(aabb& output_box) const {
+    // Negative radius spheres (hollow glass) have the same bounds
+    auto r = fabs(radius);
+    output_box = aabb(center - vec3(r, r, r), center + vec3(r, r, r));
+    return true;
+}
@@ -131,7 +131,7 @@ static inline vec3 unit_vector(vec3 v) {
 
 // Perhaps don't inline this? Function feels a little too big
 // to inline
-static vec3 random_in_unit_sphere() {
+inline vec3 random_in_unit_sphere() {
     while (true) {
         auto p = vec3::random(-1, 1);
         if (p.length_squared() >= 1) {
@@ -141,11 +141,11 @@ static vec3 random_in_unit_sphere() {
     }
 }
 
-static vec3 random_unit_vector() {
+inline vec3 random_unit_vector() {
     return unit_vector(random_in_unit_sphere());
 }
 
-static vec3 random_in_hemisphere(const vec3& normal) {
+inline vec3 random_in_hemisphere(const vec3& normal) {
     vec3 in_unit_sphere = random_in_unit_sphere();
     // In the same hemisphere as the normal
     if (dot(in_unit_sphere, normal) > 0.0) {
@@ -156,11 +156,11 @@ static vec3 random_in_hemisphere(const vec3& normal) {
 }
 
 // Get the reflected ray
-static vec3 reflect(const vec3& v, const vec3& n) {
+inline vec3 reflect(const vec3& v, const vec3& n) {
     return v - 2 * dot(v, n) * n;
 }
 
-static vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
+inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
     // uv and n are unit vectors, dot product to get cos_theta
     auto cos_theta = fmin(dot(-uv, n), 1.0);
     // perpendicular -> r(perpendicular) = n/n^n * (r + cos_theta * n)
@@ -174,7 +174,7 @@ static vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
     return r_out_perp + r_out_parallel;
 }
 
-static vec3 random_in_unit_disk() {
+inline vec3 random_in_unit_disk() {
     while (true) {
         auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0);
         if (p.length_squared() >= 1) {